@@ -0,0 +1,620 @@
+/*
+ * cache.c - The simulated cache: arena layout, lookup and fill
+ *
+ * Which way to evict is left to the cache's Policy (see policy.c).
+ * Lines carry a dirty bit: writes set it and a dirty line that is
+ * evicted counts as a writeback. simulate() applies the cache's write
+ * policy on top and keeps count of the memory traffic it causes.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "cache.h"
+#include "prefetch.h"
+#include "classify.h"
+#include "heatmap.h"
+#include "kernel.h"
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+//Addresses decoded per step of simulate_batch()
+#define BATCH 256
+
+static size_t round_to_line(size_t bytes) {
+    return (bytes + HOST_LINE - 1) & ~(size_t)(HOST_LINE - 1);
+}
+
+#ifdef __x86_64__
+/* scan_avx512 - Eight tags per compare, invalid ways masked out */
+__attribute__((target("avx512f")))
+static int scan_avx512(const uint64_t *tags, const uint8_t *valid, int E, uint64_t tag) {
+    __m512i key = _mm512_set1_epi64((long long)tag);
+    int i = 0;
+    for (; i + 8 <= E; i += 8) {
+        __m512i v = _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)(valid + i)));
+        __mmask8 live = _mm512_test_epi64_mask(v, v);
+        __mmask8 hit = _mm512_mask_cmpeq_epi64_mask(live, _mm512_loadu_si512(tags + i), key);
+        if (hit) {
+            return i + __builtin_ctz(hit);
+        }
+    }
+    for (; i < E; i++) {
+        if (valid[i] && tags[i] == tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* scan_avx2 - Four tags per compare, invalid ways masked out */
+__attribute__((target("avx2")))
+static int scan_avx2(const uint64_t *tags, const uint8_t *valid, int E, uint64_t tag) {
+    __m256i key = _mm256_set1_epi64x((long long)tag);
+    __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= E; i += 4) {
+        uint32_t bytes;
+        memcpy(&bytes, valid + i, sizeof(bytes));
+        __m256i v = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128((int)bytes));
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(tags + i)), key);
+        int hit = _mm256_movemask_pd(_mm256_castsi256_pd(eq)) &
+                  ~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, zero)));
+        if (hit) {
+            return i + __builtin_ctz(hit);
+        }
+    }
+    for (; i < E; i++) {
+        if (valid[i] && tags[i] == tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+#endif
+
+/* The widest tag compare this CPU runs, if the set is wide enough to use it */
+static int (*pick_scan(int E))(const uint64_t *, const uint8_t *, int, uint64_t) {
+#ifdef __x86_64__
+    if (E >= 8 && __builtin_cpu_supports("avx512f")) {
+        return scan_avx512;
+    }
+    if (E >= 4 && __builtin_cpu_supports("avx2")) {
+        return scan_avx2;
+    }
+#endif
+    return NULL;
+}
+
+int init_cache(Cache *cache, int s, int E, int b, const Policy *policy) {
+    policy = specialize_policy(policy, E);
+    cache->s = s;
+    cache->E = E;
+    cache->b = b;
+    cache->S = (uint64_t)1 << s;
+    cache->policy = policy;
+    cache->set_stride = policy->set_words + E * policy->set_words_per_way;
+    cache->timer = 0;
+    cache->write_mode = 0;
+    cache->prefetcher = NULL;
+    cache->classifier = NULL;
+    cache->heatmap = NULL;
+    cache->split = false;
+    reset_counters(cache);
+
+    size_t lines = cache->S * E;
+    size_t tag_bytes = round_to_line(lines * sizeof(uint64_t));
+    size_t valid_bytes = round_to_line(lines * sizeof(uint8_t));
+    size_t dirty_bytes = round_to_line(lines * sizeof(uint8_t));
+    size_t prefetched_bytes = round_to_line(lines * sizeof(uint8_t));
+    size_t way_bytes = round_to_line(lines * policy->way_words * sizeof(uint64_t));
+    size_t set_bytes = round_to_line(cache->S * cache->set_stride * sizeof(uint64_t));
+    size_t index_slots = 0;
+    if (policy->indexed) {
+        //At most half full
+        for (index_slots = 1; index_slots < 2 * (size_t)E; index_slots *= 2)
+            ;
+    }
+    cache->index_mask = index_slots - 1;
+    size_t index_bytes = round_to_line(cache->S * index_slots * sizeof(int32_t));
+    size_t total = tag_bytes + valid_bytes + dirty_bytes + prefetched_bytes + way_bytes + set_bytes + index_bytes;
+
+    if (posix_memalign(&cache->arena, HOST_LINE, total) != 0) {
+        return -1;
+    }
+    cache->arena_bytes = total;
+
+    char *p = cache->arena;
+    cache->tags = (uint64_t *)p;
+    p += tag_bytes;
+    cache->valid = (uint8_t *)p;
+    p += valid_bytes;
+    cache->dirty = (uint8_t *)p;
+    p += dirty_bytes;
+    cache->prefetched = (uint8_t *)p;
+    p += prefetched_bytes;
+    cache->way_state = (uint64_t *)p;
+    p += way_bytes;
+    cache->set_state = (uint64_t *)p;
+    p += set_bytes;
+    cache->index = policy->indexed ? (int32_t *)p : NULL;
+    cache->scan = policy->indexed ? NULL : pick_scan(E);
+    cache->kernel = find_kernel(s, E, b, policy);
+    clear_cache(cache);
+    return 0;
+}
+
+void clear_cache(Cache *cache) {
+    //Everything starts invalid with zeroed policy state
+    memset(cache->arena, 0, cache->arena_bytes);
+    if (cache->index != NULL) {
+        memset(cache->index, 0xff,
+               cache->S * (cache->index_mask + 1) * sizeof(int32_t));
+    }
+    if (cache->policy->init != NULL) {
+        cache->policy->init(cache);
+    }
+    cache->timer = 0;
+    reset_counters(cache);
+}
+
+void free_cache(Cache *cache) {
+    free(cache->arena);
+    cache->arena = NULL;
+}
+
+void reset_counters(Cache *cache) {
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    cache->writebacks = 0;
+    cache->fills = 0;
+    cache->direct_writes = 0;
+    cache->direct_write_bytes = 0;
+    cache->prefetch_fills = 0;
+    cache->prefetch_hits = 0;
+    cache->prefetch_unused = 0;
+    cache->split_accesses = 0;
+}
+
+void add_counters(Cache *cache, const Cache *other) {
+    cache->hits += other->hits;
+    cache->misses += other->misses;
+    cache->evictions += other->evictions;
+    cache->writebacks += other->writebacks;
+    cache->fills += other->fills;
+    cache->direct_writes += other->direct_writes;
+    cache->direct_write_bytes += other->direct_write_bytes;
+    cache->prefetch_fills += other->prefetch_fills;
+    cache->prefetch_hits += other->prefetch_hits;
+    cache->prefetch_unused += other->prefetch_unused;
+    cache->split_accesses += other->split_accesses;
+}
+
+uint64_t read_traffic(const Cache *cache) {
+    return (uint64_t)(cache->fills + cache->prefetch_fills) << cache->b;
+}
+
+uint64_t write_traffic(const Cache *cache) {
+    return ((uint64_t)cache->writebacks << cache->b) + cache->direct_write_bytes;
+}
+
+static inline uint64_t index_hash(uint64_t tag) {
+    tag *= 0x9e3779b97f4a7c15ULL;
+    return tag ^ (tag >> 31);
+}
+
+/* Slot of the index holding tag, or the empty slot where it belongs */
+static uint64_t index_slot(Cache *cache, int32_t *slots, uint64_t *tags,
+                           uint64_t tag) {
+    uint64_t i = index_hash(tag) & cache->index_mask;
+    while (slots[i] >= 0 && tags[slots[i]] != tag) {
+        i = (i + 1) & cache->index_mask;
+    }
+    return i;
+}
+
+/* Delete slot i, shifting back later entries of its probe run */
+static void index_remove(Cache *cache, int32_t *slots, uint64_t *tags,
+                         uint64_t i) {
+    uint64_t mask = cache->index_mask;
+    uint64_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (slots[j] < 0) {
+            break;
+        }
+        uint64_t home = index_hash(tags[slots[j]]) & mask;
+        //Move j into the hole unless its home lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i] = -1;
+}
+
+/* Block address of a line, for reporting evictions */
+static inline uint64_t line_addr(Cache *cache, uint64_t set, uint64_t tag) {
+    return (tag << (cache->s + cache->b)) | (set << cache->b);
+}
+
+/*
+ * find_way - Way of set holding tag, or -1. For scanned caches *empty is
+ *     set to the first invalid way seen (or -1); indexed caches take
+ *     their fill way from the policy instead.
+ */
+static inline int find_way(Cache *cache, uint64_t set, uint64_t tag, int *empty) {
+    size_t base = set * cache->E;
+    uint64_t* tags = cache->tags + base;
+    uint8_t* valid = cache->valid + base;
+
+    *empty = -1;
+    if (cache->index != NULL) {
+        int32_t* slots = cache->index + set * (cache->index_mask + 1);
+        return slots[index_slot(cache, slots, tags, tag)];
+    }
+
+    if (cache->scan != NULL) {
+        int way = cache->scan(tags, valid, cache->E, tag);
+        if (way < 0) {
+            //First invalid way, only wanted on a miss
+            uint8_t *hole = memchr(valid, 0, cache->E);
+            *empty = hole != NULL ? (int)(hole - valid) : -1;
+        }
+        return way;
+    }
+
+    for (int i=0; i < cache->E; i++) {
+        // 1. Check for hit
+        if (valid[i] && tags[i] == tag) {
+            return i;
+        }
+        //2. Check for empty
+        if (valid[i] == 0 && *empty == -1) {
+            *empty = i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * fill_way - Put tag in set, using the empty way if there is one and the
+ *     policy's victim otherwise. Reports what was evicted in *ev.
+ */
+static int fill_way(Cache *cache, uint64_t set, uint64_t tag, int empty,
+                    bool dirty, Evicted *ev) {
+    size_t base = set * cache->E;
+    uint64_t* tags = cache->tags + base;
+    uint8_t* valid = cache->valid + base;
+    uint8_t* dirt = cache->dirty + base;
+    uint8_t* pref = cache->prefetched + base;
+    int32_t* slots = NULL;
+
+    int way = empty;
+    if (cache->index != NULL) {
+        slots = cache->index + set * (cache->index_mask + 1);
+        //Indexed policies hand out empty ways themselves
+        way = cache->policy->victim(cache, set);
+    }
+    else if (way < 0) {
+        //Eviction needed, the policy picks the victim
+        way = cache->policy->victim(cache, set);
+    }
+
+    ev->valid = valid[way];
+    if (valid[way]) {
+        ev->addr = line_addr(cache, set, tags[way]);
+        ev->dirty = dirt[way];
+        ev->prefetched = pref[way];
+        cache->evictions++;
+        if (pref[way]) {
+            cache->prefetch_unused++;
+        }
+        if (dirt[way]) {
+            cache->writebacks++;
+        }
+        if (slots != NULL) {
+            index_remove(cache, slots, tags, index_slot(cache, slots, tags, tags[way]));
+        }
+    }
+
+    tags[way] = tag;
+    valid[way] = 1;
+    dirt[way] = dirty;
+    pref[way] = 0;
+    if (slots != NULL) {
+        slots[index_slot(cache, slots, tags, tag)] = way;
+    }
+    cache->policy->on_fill(cache, set, way);
+    return way;
+}
+
+int access_cache(Cache* cache, uint64_t setIdx, uint64_t tag, int flags, Evicted* ev){
+    cache->timer++;
+    ev->valid = false;
+
+    int empty;
+    int way = find_way(cache, setIdx, tag, &empty);
+    if (way >= 0) {
+        //Cache hit
+        cache->hits++;
+        size_t line = setIdx * cache->E + way;
+        if (flags & CACHE_WRITE) {
+            cache->dirty[line] = 1;
+        }
+        if (cache->prefetched[line]) {
+            //First use of a prefetched line
+            cache->prefetched[line] = 0;
+            cache->prefetch_hits++;
+        }
+        cache->policy->on_hit(cache, setIdx, way);
+        return CACHE_HIT;
+    }
+
+    //Cache miss
+    cache->misses++;
+    if (flags & CACHE_NO_ALLOC) {
+        return CACHE_MISS;
+    }
+    cache->fills++;
+    fill_way(cache, setIdx, tag, empty, (flags & CACHE_WRITE) != 0, ev);
+    return ev->valid ? CACHE_MISS_EVICT : CACHE_MISS;
+}
+
+int access_block(Cache *cache, uint64_t addr, int flags, Evicted *ev) {
+    uint64_t setIdx = (addr >> cache->b) & (cache->S - 1);
+    uint64_t tag = addr >> (cache->b + cache->s);
+    return access_cache(cache, setIdx, tag, flags, ev);
+}
+
+bool insert_block(Cache *cache, uint64_t addr, bool dirty, Evicted *ev) {
+    uint64_t setIdx = (addr >> cache->b) & (cache->S - 1);
+    uint64_t tag = addr >> (cache->b + cache->s);
+    cache->timer++;
+    ev->valid = false;
+
+    int empty;
+    int way = find_way(cache, setIdx, tag, &empty);
+    if (way >= 0) {
+        cache->dirty[setIdx * cache->E + way] |= dirty;
+        cache->policy->on_hit(cache, setIdx, way);
+        return true;
+    }
+    fill_way(cache, setIdx, tag, empty, dirty, ev);
+    return false;
+}
+
+bool prefetch_block(Cache *cache, uint64_t addr, Evicted *ev) {
+    uint64_t setIdx = (addr >> cache->b) & (cache->S - 1);
+    uint64_t tag = addr >> (cache->b + cache->s);
+    cache->timer++;
+    ev->valid = false;
+
+    int empty;
+    if (find_way(cache, setIdx, tag, &empty) >= 0) {
+        return true;
+    }
+    int way = fill_way(cache, setIdx, tag, empty, false, ev);
+    cache->prefetched[setIdx * cache->E + way] = 1;
+    cache->prefetch_fills++;
+    return false;
+}
+
+bool invalidate_block(Cache *cache, uint64_t addr, bool *dirty) {
+    uint64_t setIdx = (addr >> cache->b) & (cache->S - 1);
+    uint64_t tag = addr >> (cache->b + cache->s);
+
+    int empty;
+    int way = find_way(cache, setIdx, tag, &empty);
+    if (way < 0) {
+        return false;
+    }
+
+    size_t line = setIdx * cache->E + way;
+    if (dirty != NULL) {
+        *dirty = cache->dirty[line];
+    }
+    if (cache->index != NULL) {
+        int32_t* slots = cache->index + setIdx * (cache->index_mask + 1);
+        uint64_t* tags = cache->tags + setIdx * cache->E;
+        index_remove(cache, slots, tags, index_slot(cache, slots, tags, tag));
+    }
+    cache->valid[line] = 0;
+    cache->dirty[line] = 0;
+    cache->prefetched[line] = 0;
+    if (cache->policy->on_invalidate != NULL) {
+        cache->policy->on_invalidate(cache, setIdx, way);
+    }
+    return true;
+}
+
+bool contains_block(Cache *cache, uint64_t addr) {
+    uint64_t setIdx = (addr >> cache->b) & (cache->S - 1);
+    uint64_t tag = addr >> (cache->b + cache->s);
+    int empty;
+    return find_way(cache, setIdx, tag, &empty) >= 0;
+}
+
+int64_t find_block(Cache *cache, uint64_t addr) {
+    uint64_t setIdx = (addr >> cache->b) & (cache->S - 1);
+    uint64_t tag = addr >> (cache->b + cache->s);
+    int empty;
+    int way = find_way(cache, setIdx, tag, &empty);
+    return way < 0 ? -1 : (int64_t)(setIdx * cache->E + way);
+}
+
+static void print_result(int result) {
+    static const char *const names[] = {"hit ", "miss ", "miss eviction "};
+    printf("%s", names[result]);
+}
+
+/* One store under the cache's write policy */
+static int store(Cache *cache, uint64_t setIdx, uint64_t tag, int size, Evicted *ev) {
+    int flags = 0;
+    if (!(cache->write_mode & WRITE_THROUGH)) {
+        flags |= CACHE_WRITE;
+    }
+    if (cache->write_mode & WRITE_NO_ALLOCATE) {
+        flags |= CACHE_NO_ALLOC;
+    }
+
+    int result = access_cache(cache, setIdx, tag, flags, ev);
+    //Write-through sends every store on, no-allocate sends missing ones
+    if ((cache->write_mode & WRITE_THROUGH) ||
+        (result != CACHE_HIT && (cache->write_mode & WRITE_NO_ALLOCATE))) {
+        cache->direct_writes++;
+        cache->direct_write_bytes += size;
+    }
+    return result;
+}
+
+/* One demand load or store, with the prefetcher, classifier and heatmap (if any) looking on */
+static int demand(Cache *cache, uint64_t address, uint64_t setIdx, uint64_t tag,
+                  bool write, int size) {
+    Prefetcher *pf = cache->prefetcher;
+    long used = cache->prefetch_hits;
+    Evicted ev;
+
+    if (pf != NULL) {
+        prefetch_before(pf, cache, address);
+    }
+    int result = write ? store(cache, setIdx, tag, size, &ev)
+                       : access_cache(cache, setIdx, tag, 0, &ev);
+    if (pf != NULL) {
+        prefetch_after(pf, cache, address, result, cache->prefetch_hits != used);
+    }
+    if (cache->classifier != NULL) {
+        bool no_alloc = write && (cache->write_mode & WRITE_NO_ALLOCATE);
+        classify_access(cache->classifier, cache, address,
+                        no_alloc ? CACHE_NO_ALLOC : 0, result);
+    }
+    if (cache->heatmap != NULL) {
+        heatmap_access(cache->heatmap, cache, address, result);
+    }
+    return result;
+}
+
+/*
+ * One trace operation within a single block. verbose is a constant at
+ * every call, so the plain path carries no printing at all.
+ */
+static inline void simulate_block(Cache *cache, char operation, uint64_t address,
+                                  uint64_t setIdx, uint64_t tag, int size,
+                                  bool verbose) {
+    int result;
+
+    if (operation == 'L' || operation == 'M') {
+        //A Modify is a Load then a Store
+        result = demand(cache, address, setIdx, tag, false, size);
+        if (verbose) {
+            print_result(result);
+        }
+    }
+    if (operation == 'S' || operation == 'M') {
+        result = demand(cache, address, setIdx, tag, true, size);
+        if (verbose) {
+            print_result(result);
+        }
+    }
+}
+
+static inline void simulate_access(Cache *cache, char operation, uint64_t address,
+                                   int size, bool verbose) {
+    //Fast path, almost every access fits in its block
+    if (!cache->split || !spans_blocks(cache, address, size)) {
+        simulate_block(cache, operation, address,
+                       (address >> cache->b) & (cache->S - 1),
+                       address >> (cache->b + cache->s), size, verbose);
+        return;
+    }
+
+    //Each block gets its share of the bytes
+    cache->split_accesses++;
+    uint64_t end = address + size;
+    uint64_t block_size = (uint64_t)1 << cache->b;
+    while (address < end) {
+        uint64_t next = (address | (block_size - 1)) + 1;
+        uint64_t piece = (next < end ? next : end) - address;
+        simulate_block(cache, operation, address,
+                       (address >> cache->b) & (cache->S - 1),
+                       address >> (cache->b + cache->s), piece, verbose);
+        address = next;
+    }
+}
+
+/*
+ * simulate - Apply one trace operation to the cache
+ */
+void simulate(Cache *cache, char operation, uint64_t address, int size) {
+    if (kernel_ready(cache)) {
+        cache->kernel(cache, &operation, &address, 1);
+        return;
+    }
+    simulate_access(cache, operation, address, size, false);
+}
+
+void simulate_verbose(Cache *cache, char operation, uint64_t address, int size) {
+    simulate_access(cache, operation, address, size, true);
+}
+
+#ifdef __x86_64__
+/* decode_avx2 - Set and tag of four addresses per step */
+__attribute__((target("avx2")))
+static void decode_avx2(const Cache *cache, const uint64_t *addrs, size_t n,
+                        uint64_t *sets, uint64_t *tags) {
+    __m128i set_shift = _mm_cvtsi32_si128(cache->b);
+    __m128i tag_shift = _mm_cvtsi32_si128(cache->b + cache->s);
+    __m256i mask = _mm256_set1_epi64x((long long)(cache->S - 1));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(addrs + i));
+        _mm256_storeu_si256((__m256i *)(sets + i),
+                            _mm256_and_si256(_mm256_srl_epi64(a, set_shift), mask));
+        _mm256_storeu_si256((__m256i *)(tags + i), _mm256_srl_epi64(a, tag_shift));
+    }
+    for (; i < n; i++) {
+        sets[i] = (addrs[i] >> cache->b) & (cache->S - 1);
+        tags[i] = addrs[i] >> (cache->b + cache->s);
+    }
+}
+#endif
+
+static void decode(const Cache *cache, const uint64_t *addrs, size_t n,
+                   uint64_t *sets, uint64_t *tags) {
+#ifdef __x86_64__
+    if (__builtin_cpu_supports("avx2")) {
+        decode_avx2(cache, addrs, n, sets, tags);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        sets[i] = (addrs[i] >> cache->b) & (cache->S - 1);
+        tags[i] = addrs[i] >> (cache->b + cache->s);
+    }
+}
+
+void simulate_batch(Cache *cache, const char *ops, const uint64_t *addrs,
+                    const int *sizes, size_t n) {
+    uint64_t sets[BATCH];
+    uint64_t tags[BATCH];
+
+    if (kernel_ready(cache)) {
+        cache->kernel(cache, ops, addrs, n);
+        return;
+    }
+    for (size_t base = 0; base < n; base += BATCH) {
+        size_t m = n - base < BATCH ? n - base : BATCH;
+        decode(cache, addrs + base, m, sets, tags);
+        for (size_t i = 0; i < m; i++) {
+            uint64_t addr = addrs[base + i];
+            int size = sizes != NULL ? sizes[base + i] : 1;
+            if (cache->split && spans_blocks(cache, addr, size)) {
+                simulate_access(cache, ops[base + i], addr, size, false);
+                continue;
+            }
+            simulate_block(cache, ops[base + i], addr, sets[i], tags[i], size, false);
+        }
+    }
+}
@@ -0,0 +1,206 @@
+/*
+ * cache.h - The simulated cache and its replacement policies
+ */
+#ifndef CSIM_CACHE_H
+#define CSIM_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Host cache line size, every array in the arena starts on one of these
+#define HOST_LINE 64
+
+typedef struct Cache Cache;
+typedef struct Prefetcher Prefetcher;
+typedef struct Classifier Classifier;
+typedef struct Heatmap Heatmap;
+
+/* A simulator for one fixed geometry, n accesses at a time (see kernel.h) */
+typedef void (*Kernel)(Cache *cache, const char *ops, const uint64_t *addrs, size_t n);
+
+/*
+ * Policy - A replacement policy. Each policy gets way_words words of
+ * state per way and set_words + E * set_words_per_way words per set in
+ * the cache arena, all zeroed at start (then passed to init, if set).
+ *
+ * An indexed policy also gets a per-set hash table from tag to way, so
+ * hits are found without scanning the set. Its victim hook is then
+ * asked for a way on every miss and must return an invalid way while
+ * the set has one.
+ */
+typedef struct {
+    const char *name;
+    const char *description;
+    int way_words;
+    int set_words;
+    int set_words_per_way;
+    /* Returns NULL if the policy supports E ways, otherwise why not */
+    const char *(*check)(int E);
+    /* A valid way was hit */
+    void (*on_hit)(Cache *cache, uint64_t set, int way);
+    /* A way was (re)filled, either an empty one or the victim */
+    void (*on_fill)(Cache *cache, uint64_t set, int way);
+    /* Pick the way to evict from a full set */
+    int (*victim)(Cache *cache, uint64_t set);
+    /* Optional, set up the zeroed state */
+    void (*init)(Cache *cache);
+    /* Optional, a way was invalidated from outside (e.g. by a lower level) */
+    void (*on_invalidate)(Cache *cache, uint64_t set, int way);
+    int indexed;
+} Policy;
+
+/*
+ * Cache - All sets live in one contiguous, host-line-aligned arena
+ * (S x E ways), split into structure-of-arrays so the way scan only
+ * walks the tags and valid bits of a single set.
+ * Way j of set i is at index i*E + j of every per-way array.
+ * Each cache keeps its own clock and counters so several geometries
+ * can be simulated side by side.
+ */
+struct Cache {
+    int s;
+    int E;
+    int b;
+    uint64_t S;
+    uint64_t *tags;
+    uint8_t *valid; //valid bit 0 or 1
+    uint8_t *dirty; //dirty bit 0 or 1
+    uint8_t *prefetched; //filled by a prefetch and not used yet
+    uint64_t *way_state; //policy words, way_words per way
+    uint64_t *set_state; //policy words, set_stride per set
+    int set_stride;
+    int32_t *index; //indexed policies only, tag -> way, -1 if empty
+    //Vector tag compare for scanned sets (hit way or -1), NULL for the scalar loop
+    int (*scan)(const uint64_t *tags, const uint8_t *valid, int E, uint64_t tag);
+    Kernel kernel; //specialized for this geometry, NULL for the generic path
+    uint64_t index_mask; //slots per set minus one
+    const Policy *policy;
+    void *arena;
+    size_t arena_bytes;
+    uint64_t timer;
+    long hits;
+    long misses;
+    long evictions;
+    int write_mode; //WRITE_* bits
+    bool split; //touch every block an access spans, not just the first
+    long writebacks; //dirty lines evicted
+    long fills; //lines read in from memory on a miss
+    long direct_writes; //stores sent straight to memory
+    uint64_t direct_write_bytes;
+    Prefetcher *prefetcher; //NULL unless prefetching (see prefetch.h)
+    Classifier *classifier; //NULL unless classifying misses (see classify.h)
+    Heatmap *heatmap; //NULL unless counting per set and region (see heatmap.h)
+    long prefetch_fills; //lines read in by prefetches
+    long prefetch_hits; //first demand hits on prefetched lines
+    long prefetch_unused; //prefetched lines evicted before any use
+    long split_accesses; //accesses that spanned more than one block
+};
+
+/* What a fill pushed out of the cache */
+typedef struct {
+    bool valid; //a line was evicted
+    bool dirty;
+    bool prefetched; //a prefetched line that was never used
+    uint64_t addr; //its block address
+} Evicted;
+
+/* Cache write_mode bits, the default 0 is write-back and write-allocate */
+#define WRITE_THROUGH 1 //every store also goes to memory, lines stay clean
+#define WRITE_NO_ALLOCATE 2 //a store miss goes to memory without a fill
+
+/* Results of access_cache() */
+enum { CACHE_HIT, CACHE_MISS, CACHE_MISS_EVICT };
+
+/* access_cache() flags */
+#define CACHE_WRITE 1 //the access is a store, set the dirty bit
+#define CACHE_NO_ALLOC 2 //count a miss but do not fill the line
+
+/* Policy state of a set, and of one way of it */
+static inline uint64_t *set_state(Cache *cache, uint64_t set) {
+    return cache->set_state + set * cache->set_stride;
+}
+
+static inline uint64_t *way_state(Cache *cache, uint64_t set, int way) {
+    return cache->way_state +
+           (set * cache->E + way) * cache->policy->way_words;
+}
+
+/* Allocate an empty cache. Returns 0 on success, -1 on error */
+int init_cache(Cache *cache, int s, int E, int b, const Policy *policy);
+
+void free_cache(Cache *cache);
+
+/* Empty every set and zero the counters, keeping geometry and settings */
+void clear_cache(Cache *cache);
+
+/* Look up tag in set, filling it on a miss. Returns a CACHE_* result */
+int access_cache(Cache* cache, uint64_t setIdx, uint64_t tag, int flags, Evicted* ev);
+
+/* access_cache() on the set and tag of addr */
+int access_block(Cache *cache, uint64_t addr, int flags, Evicted *ev);
+
+/*
+ * Place a block without counting an access, e.g. a victim or writeback
+ * arriving from the level above. Returns true if it was already present
+ * (dirty is then or'ed into the line, and the policy sees a hit).
+ */
+bool insert_block(Cache *cache, uint64_t addr, bool dirty, Evicted *ev);
+
+/*
+ * Fill a block for a prefetch, without counting an access or touching
+ * the replacement state of a block already present. Returns true if it
+ * was present.
+ */
+bool prefetch_block(Cache *cache, uint64_t addr, Evicted *ev);
+
+/* Drop a block if present. Returns true if it was, with its dirty bit */
+bool invalidate_block(Cache *cache, uint64_t addr, bool *dirty);
+
+/* Whether a block is present, without touching replacement state */
+bool contains_block(Cache *cache, uint64_t addr);
+
+/* Line index (set*E + way) of a block, or -1, without touching replacement state */
+int64_t find_block(Cache *cache, uint64_t addr);
+
+/* Whether size bytes at addr fall in more than one block */
+static inline bool spans_blocks(const Cache *cache, uint64_t addr, int size) {
+    uint64_t offset = addr & (((uint64_t)1 << cache->b) - 1);
+    return offset + (uint64_t)size > ((uint64_t)1 << cache->b);
+}
+
+/* Zero the counters, and add another cache's counters to these */
+void reset_counters(Cache *cache);
+void add_counters(Cache *cache, const Cache *other);
+
+/* Bytes read from and written to memory so far */
+uint64_t read_traffic(const Cache *cache);
+uint64_t write_traffic(const Cache *cache);
+
+/*
+ * Decode an address and apply one trace operation ('L', 'S' or 'M') of
+ * size bytes under the cache's write policy. With split set, an access
+ * spanning several blocks touches each of them in turn.
+ */
+void simulate(Cache *cache, char operation, uint64_t address, int size);
+
+/* simulate(), printing "hit ", "miss " or "miss eviction " for each lookup */
+void simulate_verbose(Cache *cache, char operation, uint64_t address, int size);
+
+/*
+ * simulate() on n accesses in order, decoding a whole run of addresses
+ * at a time. sizes may be NULL for 1-byte accesses.
+ */
+void simulate_batch(Cache *cache, const char *ops, const uint64_t *addrs,
+                    const int *sizes, size_t n);
+
+/* Policy by name, or NULL */
+const Policy *find_policy(const char *name);
+
+/* The implementation of policy a cache with E ways actually runs */
+const Policy *specialize_policy(const Policy *policy, int E);
+
+/* All policies, terminated by a NULL entry */
+extern const Policy *const policies[];
+
+#endif /* CSIM_CACHE_H */
@@ -34,4 +34,21 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/*
+ * LOAD(x), STORE(x, v) - How transpose functions read and write A and
+ * B, e.g. STORE(B[j][i], LOAD(A[i][j])). In tracegen they are plain
+ * accesses. test-trans builds trans.c again with TRACE_TRANS, where
+ * each one is also handed to its in-process tracer (tracer.c), in the
+ * order the accesses happen: a store after the value it stores.
+ */
+#ifdef TRACE_TRANS
+void tracer_load(const volatile void *addr, int size);
+long tracer_store(const volatile void *addr, int size, long v);
+#define LOAD(x) (tracer_load(&(x), sizeof(x)), (x))
+#define STORE(x, v) ((x) = tracer_store(&(x), sizeof(x), (v)))
+#else
+#define LOAD(x) (x)
+#define STORE(x, v) ((x) = (v))
+#endif
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,171 @@
+/*
+ * checkpoint.c - Save and restore a serial simulation mid-trace
+ *
+ * Layout: a CheckpointHeader, then per cache a CheckpointCache followed
+ * by arena_bytes of its arena.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAGIC "CSIMCKPT"
+#define CHECKPOINT_VERSION 2
+#define POLICY_NAME_LEN 16
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t ncaches;
+    TracePos pos;
+} CheckpointHeader;
+
+typedef struct {
+    int32_t s;
+    int32_t E;
+    int32_t b;
+    int32_t write_mode;
+    int32_t split;
+    char policy[POLICY_NAME_LEN];
+    uint64_t timer;
+    int64_t counters[11];
+    uint64_t arena_bytes;
+} CheckpointCache;
+
+/* Pack a cache's counters in a fixed order, or unpack them */
+static void get_counters(const Cache *c, int64_t *v) {
+    v[0] = c->hits;
+    v[1] = c->misses;
+    v[2] = c->evictions;
+    v[3] = c->writebacks;
+    v[4] = c->fills;
+    v[5] = c->direct_writes;
+    v[6] = c->direct_write_bytes;
+    v[7] = c->prefetch_fills;
+    v[8] = c->prefetch_hits;
+    v[9] = c->prefetch_unused;
+    v[10] = c->split_accesses;
+}
+
+static void set_counters(Cache *c, const int64_t *v) {
+    c->hits = v[0];
+    c->misses = v[1];
+    c->evictions = v[2];
+    c->writebacks = v[3];
+    c->fills = v[4];
+    c->direct_writes = v[5];
+    c->direct_write_bytes = v[6];
+    c->prefetch_fills = v[7];
+    c->prefetch_hits = v[8];
+    c->prefetch_unused = v[9];
+    c->split_accesses = v[10];
+}
+
+int checkpoint_save(const char *path, const Cache *caches, int ncaches,
+                    const TracePos *pos) {
+    size_t len = strlen(path);
+    char *tmp = malloc(len + 5);
+    if (tmp == NULL) {
+        return -1;
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        free(tmp);
+        return -1;
+    }
+
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    h.version = CHECKPOINT_VERSION;
+    h.ncaches = ncaches;
+    h.pos = *pos;
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+
+    for (int i = 0; ok && i < ncaches; i++) {
+        const Cache *c = &caches[i];
+        CheckpointCache cc;
+        memset(&cc, 0, sizeof(cc));
+        cc.s = c->s;
+        cc.E = c->E;
+        cc.b = c->b;
+        cc.write_mode = c->write_mode;
+        cc.split = c->split;
+        strncpy(cc.policy, c->policy->name, POLICY_NAME_LEN - 1);
+        cc.timer = c->timer;
+        get_counters(c, cc.counters);
+        cc.arena_bytes = c->arena_bytes;
+        ok = fwrite(&cc, sizeof(cc), 1, fp) == 1 &&
+             fwrite(c->arena, 1, c->arena_bytes, fp) == c->arena_bytes;
+    }
+
+    //On disk before it replaces the old one
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        remove(tmp);
+    }
+    free(tmp);
+    return ok ? 0 : -1;
+}
+
+const char *checkpoint_load(const char *path, Cache *caches, int ncaches,
+                            TracePos *pos) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return "cannot be opened";
+    }
+
+    const char *why = NULL;
+    CheckpointHeader h;
+    if (fread(&h, sizeof(h), 1, fp) != 1 ||
+        memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) != 0) {
+        why = "is not a checkpoint";
+    }
+    else if (h.version != CHECKPOINT_VERSION) {
+        why = "is from another version";
+    }
+    else if (h.ncaches != (uint32_t)ncaches) {
+        why = "holds a different number of caches";
+    }
+
+    for (int i = 0; why == NULL && i < ncaches; i++) {
+        Cache *c = &caches[i];
+        CheckpointCache cc;
+        if (fread(&cc, sizeof(cc), 1, fp) != 1) {
+            why = "is truncated";
+        }
+        else if (cc.s != c->s || cc.E != c->E || cc.b != c->b ||
+                 cc.arena_bytes != c->arena_bytes) {
+            why = "holds a different geometry";
+        }
+        else if (strncmp(cc.policy, c->policy->name, POLICY_NAME_LEN - 1) != 0) {
+            why = "holds a different replacement policy";
+        }
+        else if (pos != NULL && (cc.write_mode != c->write_mode || cc.split != c->split)) {
+            why = "was taken with different -w or -B";
+        }
+        else if (fread(c->arena, 1, c->arena_bytes, fp) != c->arena_bytes) {
+            why = "is truncated";
+        }
+        else {
+            //Policy state is stamped with this clock, keep it either way
+            c->timer = cc.timer;
+            if (pos != NULL) {
+                set_counters(c, cc.counters);
+            }
+        }
+    }
+    fclose(fp);
+
+    if (why == NULL && pos != NULL) {
+        *pos = h.pos;
+    }
+    return why;
+}
@@ -0,0 +1,34 @@
+/*
+ * checkpoint.h - Save a serial simulation mid-trace and pick it up again
+ *
+ * A checkpoint holds every cache's arena (tags, valid and dirty bits,
+ * policy state), its clock and counters, and how far into the trace the
+ * run got. Arenas hold indices and timestamps, never pointers, so they
+ * restore byte for byte into freshly initialised caches of the same
+ * geometry and policy. Files are in host byte order.
+ */
+#ifndef CSIM_CHECKPOINT_H
+#define CSIM_CHECKPOINT_H
+
+#include "cache.h"
+#include "trace.h"
+
+/*
+ * Write the caches and the trace position to path. The file is written
+ * aside and renamed over path, so an interrupted save leaves the last
+ * checkpoint intact. Returns 0 on success, -1 on error.
+ */
+int checkpoint_save(const char *path, const Cache *caches, int ncaches,
+                    const TracePos *pos);
+
+/*
+ * Load a checkpoint into caches already set up the way they were saved.
+ * With pos, resume: counters, write policy and trace position come back
+ * too. Without, warm start: only the contents (and the clock they are
+ * stamped with) are loaded, counters stay at zero. Returns NULL on
+ * success, otherwise an error message.
+ */
+const char *checkpoint_load(const char *path, Cache *caches, int ncaches,
+                            TracePos *pos);
+
+#endif /* CSIM_CHECKPOINT_H */
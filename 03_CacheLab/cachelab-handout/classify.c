@@ -0,0 +1,96 @@
+/*
+ * classify.c - 3C miss classification with a first-touch set and a
+ *     fully associative shadow cache
+ *
+ * The shadow cache is an ordinary Cache with s=0 and E=S*E, so wide
+ * shadows run on the indexed LRU list and stay O(1) per access.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "classify.h"
+
+static inline uint64_t hash_block(uint64_t block) {
+    block *= 0x9e3779b97f4a7c15ULL;
+    return block ^ (block >> 29);
+}
+
+/* Slot holding block, or the empty slot where it belongs */
+static uint64_t find_slot(const uint64_t *seen, uint64_t mask, uint64_t block) {
+    uint64_t i = hash_block(block) & mask;
+    while (seen[i] != 0 && seen[i] != block + 1) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_seen(Classifier *cl) {
+    uint64_t size = (cl->seen_mask + 1) * 2;
+    uint64_t *seen = calloc(size, sizeof(uint64_t));
+    if (seen == NULL) {
+        return -1;
+    }
+    for (uint64_t i = 0; i <= cl->seen_mask; i++) {
+        if (cl->seen[i] != 0) {
+            seen[find_slot(seen, size - 1, cl->seen[i] - 1)] = cl->seen[i];
+        }
+    }
+    free(cl->seen);
+    cl->seen = seen;
+    cl->seen_mask = size - 1;
+    return 0;
+}
+
+int classify_init(Classifier *cl, const Cache *cache) {
+    memset(cl, 0, sizeof(*cl));
+    uint64_t lines = cache->S * cache->E;
+    if (lines > INT32_MAX || init_cache(&cl->shadow, 0, lines, cache->b, policies[0]) != 0) {
+        return -1;
+    }
+    cl->seen_mask = 1023;
+    cl->seen = calloc(cl->seen_mask + 1, sizeof(uint64_t));
+    if (cl->seen == NULL) {
+        free_cache(&cl->shadow);
+        return -1;
+    }
+    return 0;
+}
+
+void classify_access(Classifier *cl, Cache *cache, uint64_t addr, int flags,
+                     int result) {
+    uint64_t block = addr >> cache->b;
+    Evicted ev;
+
+    //The shadow fills exactly when the real cache would
+    int shadow = access_block(&cl->shadow, addr, flags & CACHE_NO_ALLOC, &ev);
+
+    uint64_t slot = find_slot(cl->seen, cl->seen_mask, block);
+    bool first = cl->seen[slot] == 0;
+    if (first) {
+        cl->seen[slot] = block + 1;
+        //Keep the set at most half full
+        if (++cl->nseen * 2 > cl->seen_mask + 1 && grow_seen(cl) != 0) {
+            fprintf(stderr, "Error: Out of memory for the miss classifier\n");
+            exit(1);
+        }
+    }
+
+    if (result == CACHE_HIT) {
+        return;
+    }
+    if (first) {
+        cl->compulsory++;
+    }
+    else if (shadow != CACHE_HIT) {
+        cl->capacity++;
+    }
+    else {
+        cl->conflict++;
+    }
+}
+
+void classify_free(Classifier *cl) {
+    free_cache(&cl->shadow);
+    free(cl->seen);
+    cl->seen = NULL;
+}
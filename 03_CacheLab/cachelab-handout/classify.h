@@ -0,0 +1,32 @@
+/*
+ * classify.h - Compulsory / capacity / conflict (3C) miss classification
+ *
+ * A miss is compulsory if its block was never touched before, capacity
+ * if a fully associative LRU cache of the same size (a shadow cache fed
+ * the same accesses) misses too, and conflict otherwise.
+ */
+#ifndef CSIM_CLASSIFY_H
+#define CSIM_CLASSIFY_H
+
+#include "cache.h"
+
+struct Classifier {
+    Cache shadow;           /* one set of S*E ways, LRU */
+    uint64_t *seen;         /* open addressed set of block + 1, 0 if empty */
+    uint64_t seen_mask;
+    uint64_t nseen;
+    long compulsory;
+    long capacity;
+    long conflict;
+};
+
+/* Shadow a cache's geometry. Returns 0 on success, -1 on error */
+int classify_init(Classifier *cl, const Cache *cache);
+
+/* Called after every demand access of cache (see simulate()) */
+void classify_access(Classifier *cl, Cache *cache, uint64_t addr, int flags,
+                     int result);
+
+void classify_free(Classifier *cl);
+
+#endif /* CSIM_CLASSIFY_H */
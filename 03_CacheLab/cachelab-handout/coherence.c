@@ -0,0 +1,332 @@
+/*
+ * coherence.c - Snooping MESI/MOESI bus between private caches
+ *
+ * Line states live next to each core's cache in a per-line array, while
+ * the cache itself keeps tags, replacement and the dirty bit (set in M
+ * and O). The bus is atomic: a transaction and all its snoops finish
+ * before the next record is applied.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+
+enum { STATE_I, STATE_S, STATE_E, STATE_O, STATE_M };
+
+int find_protocol(const char *name, Protocol *protocol) {
+    if (strcmp(name, "mesi") == 0) {
+        *protocol = MESI;
+    }
+    else if (strcmp(name, "moesi") == 0) {
+        *protocol = MOESI;
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+static inline uint64_t hash_block(uint64_t block) {
+    block *= 0x9e3779b97f4a7c15ULL;
+    return block ^ (block >> 29);
+}
+
+/* Slot holding block, or the empty slot where it belongs */
+static uint64_t find_slot(const BlockInfo *blocks, uint64_t mask, uint64_t block) {
+    uint64_t i = hash_block(block) & mask;
+    while (blocks[i].block != 0 && blocks[i].block != block + 1) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_blocks(Coherence *co) {
+    uint64_t size = (co->blocks_mask + 1) * 2;
+    BlockInfo *blocks = calloc(size, sizeof(BlockInfo));
+    if (blocks == NULL) {
+        return -1;
+    }
+    for (uint64_t i = 0; i <= co->blocks_mask; i++) {
+        if (co->blocks[i].block != 0) {
+            blocks[find_slot(blocks, size - 1, co->blocks[i].block - 1)] = co->blocks[i];
+        }
+    }
+    free(co->blocks);
+    co->blocks = blocks;
+    co->blocks_mask = size - 1;
+    return 0;
+}
+
+/* The bus's record of a block, created on first touch */
+static BlockInfo *block_info(Coherence *co, uint64_t block) {
+    uint64_t slot = find_slot(co->blocks, co->blocks_mask, block);
+    if (co->blocks[slot].block == 0) {
+        co->blocks[slot].block = block + 1;
+        //Keep the table at most half full
+        if (++co->nblocks * 2 > co->blocks_mask + 1) {
+            if (grow_blocks(co) != 0) {
+                fprintf(stderr, "Error: Out of memory for the coherence directory\n");
+                exit(1);
+            }
+            slot = find_slot(co->blocks, co->blocks_mask, block);
+        }
+    }
+    return &co->blocks[slot];
+}
+
+int coherence_init(Coherence *co, Protocol protocol, int ncores,
+                   int s, int E, int b, const Policy *policy) {
+    memset(co, 0, sizeof(*co));
+    co->protocol = protocol;
+    co->chunk_bits = b > 6 ? b - 6 : 0;
+    co->blocks_mask = 1023;
+    co->blocks = calloc(co->blocks_mask + 1, sizeof(BlockInfo));
+    if (co->blocks == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < ncores; i++) {
+        Core *c = &co->cores[i];
+        if (init_cache(&c->cache, s, E, b, policy) != 0) {
+            coherence_free(co);
+            return -1;
+        }
+        co->ncores++;
+        c->state = calloc(c->cache.S * E, sizeof(uint8_t));
+        if (c->state == NULL) {
+            coherence_free(co);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Chunks of its block that size bytes at addr touch */
+static uint64_t touched(const Coherence *co, const Cache *cache, uint64_t addr, int size) {
+    uint64_t offset = addr & (((uint64_t)1 << cache->b) - 1);
+    uint64_t end = offset + (size > 0 ? size : 1) - 1;
+    if (end >> cache->b) {
+        //Only the first block of a spanning access is simulated
+        end = ((uint64_t)1 << cache->b) - 1;
+    }
+    int first = offset >> co->chunk_bits;
+    int last = end >> co->chunk_bits;
+    uint64_t upto = last == 63 ? ~(uint64_t)0 : ((uint64_t)1 << (last + 1)) - 1;
+    return upto & ~(((uint64_t)1 << first) - 1);
+}
+
+/* Count a miss of core on bi as a coherence miss if it lost the block */
+static void classify_miss(Coherence *co, int core, BlockInfo *bi, uint64_t mask) {
+    Core *c = &co->cores[core];
+    if (!((bi->lost >> core) & 1)) {
+        return;
+    }
+    bi->lost &= ~(1u << core);
+    c->coherence_misses++;
+    if (bi->written[core] & mask) {
+        bi->true_misses++;
+    }
+    else {
+        bi->false_misses++;
+        c->false_sharing++;
+    }
+}
+
+/* Bring addr into core's cache in state, writing back what it evicts */
+static void fill(Coherence *co, int core, uint64_t addr, int flags, uint8_t state) {
+    Core *c = &co->cores[core];
+    Evicted ev;
+    access_block(&c->cache, addr, flags, &ev);
+    if (ev.valid && ev.dirty) {
+        c->writebacks++;
+    }
+    c->state[find_block(&c->cache, addr)] = state;
+}
+
+/*
+ * Remove every other copy of a block core is about to write. On a miss
+ * (supply set) a dirty copy hands its data over to the writer rather
+ * than to memory; an upgrading writer already has the data.
+ */
+static void invalidate_others(Coherence *co, int core, BlockInfo *bi, uint64_t addr,
+                              bool supply) {
+    for (int i = 0; i < co->ncores; i++) {
+        Core *o = &co->cores[i];
+        bool dirty;
+        if (i == core || !invalidate_block(&o->cache, addr, &dirty)) {
+            continue;
+        }
+        if (dirty && supply) {
+            co->transfers++;
+        }
+        o->invalidated++;
+        bi->invalidations++;
+        bi->lost |= 1u << i;
+        bi->written[i] = 0;
+    }
+}
+
+static void load(Coherence *co, int core, BlockInfo *bi, uint64_t addr, uint64_t mask) {
+    Core *c = &co->cores[core];
+    Evicted ev;
+
+    if (contains_block(&c->cache, addr)) {
+        access_block(&c->cache, addr, 0, &ev);
+        return;
+    }
+
+    classify_miss(co, core, bi, mask);
+    co->bus_reads++;
+    bool shared = false;
+    for (int i = 0; i < co->ncores; i++) {
+        Core *o = &co->cores[i];
+        int64_t line = i == core ? -1 : find_block(&o->cache, addr);
+        if (line < 0) {
+            continue;
+        }
+        shared = true;
+        switch (o->state[line]) {
+            case STATE_M:
+                co->transfers++;
+                if (co->protocol == MOESI) {
+                    //Stays dirty, now the owner of shared copies
+                    o->state[line] = STATE_O;
+                }
+                else {
+                    //Flushed to memory on the way
+                    o->writebacks++;
+                    o->cache.dirty[line] = 0;
+                    o->state[line] = STATE_S;
+                }
+                break;
+            case STATE_O:
+                co->transfers++;
+                break;
+            case STATE_E:
+                o->state[line] = STATE_S;
+                break;
+        }
+    }
+    fill(co, core, addr, 0, shared ? STATE_S : STATE_E);
+}
+
+static void store(Coherence *co, int core, BlockInfo *bi, uint64_t addr, uint64_t mask) {
+    Core *c = &co->cores[core];
+    Evicted ev;
+    int64_t line = find_block(&c->cache, addr);
+
+    if (line >= 0) {
+        uint8_t state = c->state[line];
+        if (state == STATE_S || state == STATE_O) {
+            co->bus_upgrades++;
+            c->upgrades++;
+            invalidate_others(co, core, bi, addr, false);
+        }
+        access_block(&c->cache, addr, CACHE_WRITE, &ev);
+        c->state[line] = STATE_M;
+    }
+    else {
+        classify_miss(co, core, bi, mask);
+        co->bus_rdx++;
+        invalidate_others(co, core, bi, addr, true);
+        fill(co, core, addr, CACHE_WRITE, STATE_M);
+    }
+
+    //Every core that lost the block now sees these bytes as modified
+    for (int i = 0; i < co->ncores; i++) {
+        if ((bi->lost >> i) & 1) {
+            bi->written[i] |= mask;
+        }
+    }
+}
+
+void coherence_access(Coherence *co, int core, char op, uint64_t addr, int size) {
+    Cache *cache = &co->cores[core].cache;
+    BlockInfo *bi = block_info(co, addr >> cache->b);
+    uint64_t mask = touched(co, cache, addr, size);
+
+    bi->cores |= 1u << core;
+    //A Modify is a Load then a Store
+    if (op == 'L' || op == 'M') {
+        load(co, core, bi, addr, mask);
+    }
+    if (op == 'S' || op == 'M') {
+        store(co, core, bi, addr, mask);
+    }
+}
+
+/* Worse false sharing first, then more invalidations */
+static int compare_hot(const void *a, const void *b) {
+    const BlockInfo *x = *(const BlockInfo *const *)a;
+    const BlockInfo *y = *(const BlockInfo *const *)b;
+    if (x->false_misses != y->false_misses) {
+        return x->false_misses < y->false_misses ? 1 : -1;
+    }
+    if (x->invalidations != y->invalidations) {
+        return x->invalidations < y->invalidations ? 1 : -1;
+    }
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+void coherence_print(Coherence *co) {
+    long invalidations = 0, coherence_misses = 0, false_sharing = 0;
+
+    printf("%4s %12s %12s %12s %12s %12s %12s %12s %12s\n",
+           "core", "hits", "misses", "evictions", "coherence", "false-share",
+           "invalidated", "upgrades", "writebacks");
+    for (int i = 0; i < co->ncores; i++) {
+        Core *c = &co->cores[i];
+        printf("%4d %12ld %12ld %12ld %12ld %12ld %12ld %12ld %12ld\n",
+               i, c->cache.hits, c->cache.misses, c->cache.evictions,
+               c->coherence_misses, c->false_sharing, c->invalidated,
+               c->upgrades, c->writebacks);
+        invalidations += c->invalidated;
+        coherence_misses += c->coherence_misses;
+        false_sharing += c->false_sharing;
+    }
+    printf("bus-reads:%ld bus-rdx:%ld bus-upgrades:%ld cache-to-cache:%ld "
+           "invalidations:%ld coherence-misses:%ld false-sharing-misses:%ld\n",
+           co->bus_reads, co->bus_rdx, co->bus_upgrades, co->transfers,
+           invalidations, coherence_misses, false_sharing);
+
+    //Rank the blocks that saw false sharing
+    BlockInfo **hot = malloc((co->nblocks + 1) * sizeof(BlockInfo *));
+    uint64_t nhot = 0;
+    for (uint64_t i = 0; hot != NULL && i <= co->blocks_mask; i++) {
+        if (co->blocks[i].block != 0 && co->blocks[i].false_misses > 0) {
+            hot[nhot++] = &co->blocks[i];
+        }
+    }
+    if (nhot == 0) {
+        free(hot);
+        return;
+    }
+    qsort(hot, nhot, sizeof(BlockInfo *), compare_hot);
+    printf("\nfalse sharing hot blocks:\n");
+    printf("%18s %12s %12s %12s  %s\n",
+           "block", "false-misses", "true-misses", "invalidations", "cores");
+    for (uint64_t i = 0; i < nhot && i < HOT_BLOCKS; i++) {
+        BlockInfo *bi = hot[i];
+        printf("%18lx %12ld %12ld %12ld  ",
+               (bi->block - 1) << co->cores[0].cache.b, bi->false_misses,
+               bi->true_misses, bi->invalidations);
+        const char *sep = "";
+        for (int c = 0; c < co->ncores; c++) {
+            if ((bi->cores >> c) & 1) {
+                printf("%s%d", sep, c);
+                sep = ",";
+            }
+        }
+        printf("\n");
+    }
+    free(hot);
+}
+
+void coherence_free(Coherence *co) {
+    for (int i = 0; i < co->ncores; i++) {
+        free_cache(&co->cores[i].cache);
+        free(co->cores[i].state);
+    }
+    co->ncores = 0;
+    free(co->blocks);
+    co->blocks = NULL;
+}
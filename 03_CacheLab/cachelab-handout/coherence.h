@@ -0,0 +1,75 @@
+/*
+ * coherence.h - Private caches kept coherent by a snooping MESI or MOESI bus
+ *
+ * Each simulated core has its own cache and trace, and their records
+ * are interleaved round-robin. A load miss is a bus read, which other
+ * copies snoop (M and E drop to S, or M to O under MOESI, and a dirty
+ * copy supplies the data). A store to a missing line is a read for
+ * ownership and a store to an S or O line an upgrade, and both
+ * invalidate every other copy.
+ *
+ * A miss on a block this core last lost to another core's write is a
+ * coherence miss. It is true sharing if another core has since written
+ * a part of the block this access touches, and false sharing otherwise.
+ */
+#ifndef CSIM_COHERENCE_H
+#define CSIM_COHERENCE_H
+
+#include "cache.h"
+
+#define MAX_CORES 16
+#define HOT_BLOCKS 10   /* false sharing blocks listed in the report */
+
+typedef enum { MESI, MOESI } Protocol;
+
+typedef struct {
+    Cache cache;
+    uint8_t *state;         /* coherence state per line, while valid */
+    long upgrades;          /* stores to S/O lines, invalidating the others */
+    long invalidated;       /* copies removed by other cores' stores */
+    long coherence_misses;  /* misses on blocks lost to an invalidation */
+    long false_sharing;     /* of those, with no touched byte written since */
+    long writebacks;        /* dirty lines written to memory */
+} Core;
+
+/* What the bus knows about a block, kept for the whole run */
+typedef struct {
+    uint64_t block;         /* block + 1, 0 for an empty slot */
+    uint32_t cores;         /* cores that touched it */
+    uint32_t lost;          /* cores whose copy was invalidated, not yet missed on */
+    uint64_t written[MAX_CORES]; /* chunks stored to by others since core lost it */
+    long invalidations;
+    long false_misses;
+    long true_misses;
+} BlockInfo;
+
+typedef struct {
+    Protocol protocol;
+    int ncores;
+    Core cores[MAX_CORES];
+    int chunk_bits;         /* bytes per bit of a written mask, as a shift */
+    BlockInfo *blocks;      /* open addressed by block */
+    uint64_t blocks_mask;
+    uint64_t nblocks;
+    long bus_reads;
+    long bus_rdx;           /* reads for ownership */
+    long bus_upgrades;
+    long transfers;         /* dirty data supplied cache to cache */
+} Coherence;
+
+/* Protocol by name (mesi or moesi). Returns 0, or -1 if unknown */
+int find_protocol(const char *name, Protocol *protocol);
+
+/* ncores private caches of one geometry. Returns 0 on success, -1 on error */
+int coherence_init(Coherence *co, Protocol protocol, int ncores,
+                   int s, int E, int b, const Policy *policy);
+
+/* Apply one trace record ('L', 'S' or 'M') of core */
+void coherence_access(Coherence *co, int core, char op, uint64_t addr, int size);
+
+/* Per-core table, bus totals and the worst false sharing blocks */
+void coherence_print(Coherence *co);
+
+void coherence_free(Coherence *co);
+
+#endif /* CSIM_COHERENCE_H */
@@ -1,100 +1,720 @@
+#define _POSIX_C_SOURCE 200809L
 #include "cachelab.h"
+#include "trace.h"
+#include "stackdist.h"
+#include "cache.h"
+#include "hierarchy.h"
+#include "prefetch.h"
+#include "classify.h"
+#include "heatmap.h"
+#include "tlb.h"
+#include "coherence.h"
+#include "checkpoint.h"
+#include "sample.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 
-long global_timer = 0;
-long hit = 0;
-long miss = 0;
-long eviction = 0;
+//Records decoded per chunk of the shared access stream
+#define CHUNK_RECORDS 65536
 
+//Records per simulate_batch() call in a serial run
+#define SERIAL_RECORDS 4096
+
+//Most worker threads the parallel engine will start
+#define MAX_THREADS 256
+
+/*
+ * The parallel engine splits every cache's sets into nthreads contiguous
+ * ranges, one per worker. Sets are independent under LRU, so each worker
+ * can run its range with a private clock and private counters and the
+ * merged totals match the serial simulation exactly. Contiguous ranges
+ * (rather than interleaving) keep workers off each other's host lines.
+ *
+ * The main thread decodes the trace into two alternating chunks: while
+ * the workers simulate one, it fills the other.
+ */
 typedef struct {
-    int valid; //valid bit 0 or 1
-    long tag;
-    int lru_stamp; //time stamp of last used
-} Line;
-
-void access_cache(Line** cache, int* E, uint64_t* setIdx, uint64_t* tag, bool* verbose){
-    global_timer++;
-
-    Line* current_set = cache[*setIdx];
-
-    int emptyIdx = -1;
-    int lruIdx = 0;
-    int min_stamp = current_set[0].lru_stamp;
-
-    for (int i=0; i < *E; i++) {
-        // 1. Check for hit
-        if (current_set[i].valid && current_set[i].tag == *tag) {
-            //Cache hit
-            if (*verbose) {
-                printf("hit ");
-            }
-            hit++;
-            //Update LRU of this one
-            current_set[i].lru_stamp = global_timer ;
-            return;
+    pthread_barrier_t barrier;
+    TraceRecord *chunk;     //chunk the workers are on
+    int nrecords;           //0 tells the workers to exit
+    Cache *caches;
+    int nconfigs;
+    int per_region;         //caches of each marker region
+    int nthreads;
+} Shared;
+
+typedef struct {
+    Shared *shared;
+    int id;
+    Cache *views;           //private copies of every Cache header
+} Worker;
+
+/* Worker that owns the set of addr */
+static inline int owner(Shared *sh, Cache *c, uint64_t addr) {
+    uint64_t setIdx = (addr >> c->b) & (c->S - 1);
+    //Owner of a set is its position in the set range
+    return (int)((setIdx * sh->nthreads) >> c->s);
+}
+
+/*
+ * simulate_split - The pieces of an access spanning several blocks can
+ *     belong to different workers, each simulates its own. The owner of
+ *     the first block counts the split.
+ */
+static void simulate_split(Worker *w, Cache *c, TraceRecord *rec) {
+    uint64_t addr = rec->addr;
+    uint64_t end = addr + rec->size;
+    uint64_t block_size = (uint64_t)1 << c->b;
+
+    if (owner(w->shared, c, addr) == w->id) {
+        c->split_accesses++;
+    }
+    while (addr < end) {
+        uint64_t next = (addr | (block_size - 1)) + 1;
+        uint64_t piece = (next < end ? next : end) - addr;
+        if (owner(w->shared, c, addr) == w->id) {
+            simulate(c, rec->op, addr, piece);
+        }
+        addr = next;
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    Shared *sh = w->shared;
+
+    for (;;) {
+        //Wait for a chunk
+        pthread_barrier_wait(&sh->barrier);
+        if (sh->nrecords == 0) {
+            break;
         }
 
-        //2. Check for empty
-        if (current_set[i].valid == 0 && emptyIdx == -1) {
-            emptyIdx = i;
+        for (int r = 0; r < sh->nrecords; r++) {
+            TraceRecord *rec = &sh->chunk[r];
+            for (int i = 0; i < sh->nconfigs; i++) {
+                Cache *c = &w->views[i];
+                if (!((rec->regions >> (i / sh->per_region)) & 1)) {
+                    continue;
+                }
+                if (c->split && spans_blocks(c, rec->addr, rec->size)) {
+                    simulate_split(w, c, rec);
+                    continue;
+                }
+                if (owner(sh, c, rec->addr) == w->id) {
+                    simulate(c, rec->op, rec->addr, rec->size);
+                }
+            }
         }
 
-        //3. Check for lowest lru
-        if (current_set[i].lru_stamp < min_stamp){
-            min_stamp = current_set[i].lru_stamp;
-            lruIdx = i;
+        //Done with this chunk
+        pthread_barrier_wait(&sh->barrier);
+    }
+    return NULL;
+}
+
+static int fill_chunk(Trace *trace, TraceRecord *chunk) {
+    int n = 0;
+    while (n < CHUNK_RECORDS && trace_next(trace, &chunk[n])) {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * simulate_parallel - Run the whole trace through every cache using
+ *     nthreads set-partitioned workers, then merge their counters
+ */
+void simulate_parallel(Cache *caches, int nconfigs, int per_region, Trace *trace,
+                       int nthreads) {
+    Shared sh;
+    pthread_t tids[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    TraceRecord *chunks[2];
+
+    chunks[0] = malloc(CHUNK_RECORDS * sizeof(TraceRecord));
+    chunks[1] = malloc(CHUNK_RECORDS * sizeof(TraceRecord));
+    sh.caches = caches;
+    sh.nconfigs = nconfigs;
+    sh.per_region = per_region;
+    sh.nthreads = nthreads;
+    //Workers plus the decoding thread
+    pthread_barrier_init(&sh.barrier, NULL, nthreads + 1);
+
+    for (int t = 0; t < nthreads; t++) {
+        workers[t].shared = &sh;
+        workers[t].id = t;
+        workers[t].views = malloc(nconfigs * sizeof(Cache));
+        //Same arena, private clock and counters
+        memcpy(workers[t].views, caches, nconfigs * sizeof(Cache));
+        for (int i = 0; i < nconfigs; i++) {
+            reset_counters(&workers[t].views[i]);
         }
+        pthread_create(&tids[t], NULL, worker_main, &workers[t]);
     }
 
-    //Cache miss
-    if (emptyIdx != -1) {
-        //No eviction needed
-        current_set[emptyIdx].valid = 1;
-        current_set[emptyIdx].tag = *tag;
-        current_set[emptyIdx].lru_stamp = global_timer;
+    int cur = 0;
+    int n = fill_chunk(trace, chunks[cur]);
+    for (;;) {
+        sh.chunk = chunks[cur];
+        sh.nrecords = n;
+        pthread_barrier_wait(&sh.barrier);
+        if (n == 0) {
+            break;
+        }
+        //Decode the next chunk while this one is simulated
+        cur ^= 1;
+        n = fill_chunk(trace, chunks[cur]);
+        pthread_barrier_wait(&sh.barrier);
+    }
 
-        if (*verbose) {
-            printf("miss ");
+    for (int t = 0; t < nthreads; t++) {
+        pthread_join(tids[t], NULL);
+        for (int i = 0; i < nconfigs; i++) {
+            add_counters(&caches[i], &workers[t].views[i]);
         }
-        miss++;
+        free(workers[t].views);
+    }
+    pthread_barrier_destroy(&sh.barrier);
+    free(chunks[0]);
+    free(chunks[1]);
+}
+
+/*
+ * print_region - Lead a table row with its marker region, or the header
+ *     with the column name if region is -1. Nothing for a single region.
+ */
+static void print_region(int nregions, int region) {
+    if (nregions == 1) {
+        return;
+    }
+    if (region < 0) {
+        printf("%6s ", "region");
     }
     else {
-        //Eviction needed
-        current_set[lruIdx].lru_stamp = global_timer;
-        current_set[lruIdx].tag = *tag;
-        current_set[lruIdx].valid = 1;
-        if (*verbose) {
-            printf("miss eviction ");
+        printf("%6d ", region);
+    }
+}
+
+/* Each cache's totals at the last row of an interval time series */
+typedef struct {
+    long hits;
+    long misses;
+    long evictions;
+} Snapshot;
+
+typedef struct {
+    long every;         /* records per row */
+    long records;       /* handed to the caches so far */
+    int nconfigs;
+    int nregions;
+    Snapshot *last;     /* one per cache */
+} Series;
+
+/*
+ * series_header - Start an interval time series, one row per cache and
+ *     interval, led by the record count the interval ends at
+ */
+static void series_header(Series *series) {
+    print_region(series->nregions, -1);
+    if (series->nconfigs > 1) {
+        printf("%4s %6s %4s ", "s", "E", "b");
+    }
+    printf("%12s %12s %12s %12s\n", "records", "hits", "misses", "evictions");
+}
+
+/*
+ * series_row - Print each cache's hits, misses and evictions since the
+ *     last row
+ */
+static void series_row(Series *series, Cache *caches, int ncaches) {
+    for (int i = 0; i < ncaches; i++) {
+        Cache *c = &caches[i];
+        Snapshot *last = &series->last[i];
+        print_region(series->nregions, i / series->nconfigs);
+        if (series->nconfigs > 1) {
+            printf("%4d %6d %4d ", c->s, c->E, c->b);
         }
-        miss++;
-        eviction++;
+        printf("%12ld %12ld %12ld %12ld\n", series->records, c->hits - last->hits,
+               c->misses - last->misses, c->evictions - last->evictions);
+        last->hits = c->hits;
+        last->misses = c->misses;
+        last->evictions = c->evictions;
     }
+}
+
+/*
+ * series_count - Count n more records, printing a row if they end an
+ *     interval
+ */
+static void series_count(Series *series, Cache *caches, int ncaches, long n) {
+    series->records += n;
+    if (n > 0 && series->records % series->every == 0) {
+        series_row(series, caches, ncaches);
+    }
+}
+
+/*
+ * save_checkpoint - Snapshot the caches and where the trace is up to,
+ *     or exit with an error
+ */
+static void save_checkpoint(const char *path, Cache *caches, int ncaches, Trace *trace) {
+    TracePos pos;
+    trace_tell(trace, &pos);
+    if (checkpoint_save(path, caches, ncaches, &pos) != 0) {
+        fprintf(stderr, "Error: Could not write checkpoint %s\n", path);
+        exit(1);
+    }
+}
 
+/*
+ * simulate_serial - Run the whole trace through every cache (and the
+ *     TLB, if any) on this thread, handing each cache a batch of records
+ *     at a time. Every record must go to every cache (a single region).
+ *     With a checkpoint file, save to it at the first batch boundary
+ *     after every interval records (if not 0) and at the end. With a
+ *     series, batches stop at its interval boundaries.
+ */
+static void simulate_serial(Cache *caches, int ncaches, Tlb *tlb, Trace *trace,
+                            const char *checkpoint, long interval, Series *series) {
+    char ops[SERIAL_RECORDS];
+    uint64_t addrs[SERIAL_RECORDS];
+    int sizes[SERIAL_RECORDS];
+    TraceRecord rec;
+    long since = 0;
+    int n, limit;
 
-};
+    do {
+        limit = SERIAL_RECORDS;
+        if (series != NULL && series->every - series->records % series->every < limit) {
+            limit = series->every - series->records % series->every;
+        }
+        n = 0;
+        while (n < limit && trace_next(trace, &rec)) {
+            ops[n] = rec.op;
+            addrs[n] = rec.addr;
+            sizes[n] = rec.size;
+            n++;
+        }
+        for (int i = 0; i < ncaches; i++) {
+            simulate_batch(&caches[i], ops, addrs, sizes, n);
+        }
+        for (int r = 0; tlb != NULL && r < n; r++) {
+            tlb_access(tlb, addrs[r], sizes[r]);
+        }
+        if (series != NULL) {
+            series_count(series, caches, ncaches, n);
+        }
+        since += n;
+        if (checkpoint != NULL && interval > 0 && since >= interval) {
+            save_checkpoint(checkpoint, caches, ncaches, trace);
+            since = 0;
+        }
+    } while (n == limit);
+
+    if (checkpoint != NULL) {
+        save_checkpoint(checkpoint, caches, ncaches, trace);
+    }
+}
 
+//Most geometries one sweep can simulate at once
+#define MAX_CONFIGS 1024
 
+typedef struct {
+    int s;
+    int E;
+    int b;
+} Geometry;
 
-int main(int argc, char *argv[])
-{
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s -s <s> -E <E> -b <b> -t <trace>\n", argv[0]);
+/*
+ * parse_field - Expand one field of a sweep geometry into a list of
+ *     values. A field is a '/' separated list of numbers or lo-hi ranges,
+ *     e.g. "1/2/4/8" or "0-6". Returns the number of values, or -1.
+ */
+static int parse_field(char *field, int *vals, int max) {
+    int n = 0;
+    char *save;
+    for (char *item = strtok_r(field, "/", &save); item != NULL;
+         item = strtok_r(NULL, "/", &save)) {
+        char *end;
+        long lo = strtol(item, &end, 10);
+        long hi = lo;
+        if (end == item) {
+            return -1;
+        }
+        if (*end == '-') {
+            char *start = end + 1;
+            hi = strtol(start, &end, 10);
+            if (end == start) {
+                return -1;
+            }
+        }
+        if (*end != '\0' || lo < 0 || hi < lo) {
+            return -1;
+        }
+        for (long v = lo; v <= hi; v++) {
+            if (n == max) {
+                return -1;
+            }
+            vals[n++] = (int)v;
+        }
+    }
+    return n;
+}
+
+/*
+ * parse_sweep - Expand a sweep spec into geometries. The spec is a comma
+ *     separated list of s:E:b grids, each field as in parse_field(), e.g.
+ *     "0-4:1/2/4:5,5:1:5". Returns the number of geometries, or -1.
+ */
+static int parse_sweep(const char *spec, Geometry *geoms, int max) {
+    char *copy = strdup(spec);
+    int n = 0;
+    char *save;
+    for (char *grid = strtok_r(copy, ",", &save); grid != NULL;
+         grid = strtok_r(NULL, ",", &save)) {
+        char *fields[3];
+        int counts[3];
+        int vals[3][MAX_CONFIGS];
+
+        fields[0] = grid;
+        fields[1] = strchr(fields[0], ':');
+        fields[2] = fields[1] ? strchr(fields[1] + 1, ':') : NULL;
+        if (fields[2] == NULL) {
+            n = -1;
+            break;
+        }
+        *fields[1]++ = '\0';
+        *fields[2]++ = '\0';
+        for (int f = 0; f < 3 && n >= 0; f++) {
+            counts[f] = parse_field(fields[f], vals[f], MAX_CONFIGS);
+            if (counts[f] <= 0) {
+                n = -1;
+            }
+        }
+        if (n < 0) {
+            break;
+        }
+
+        for (int i = 0; i < counts[0]; i++) {
+            for (int j = 0; j < counts[1]; j++) {
+                for (int k = 0; k < counts[2]; k++) {
+                    if (n == max) {
+                        free(copy);
+                        return -1;
+                    }
+                    geoms[n].s = vals[0][i];
+                    geoms[n].E = vals[1][j];
+                    geoms[n].b = vals[2][k];
+                    n++;
+                }
+            }
+        }
+    }
+    free(copy);
+    return n;
+}
+
+/*
+ * parse_write_mode - Turn a comma separated write policy such as "wt,nwa"
+ *     into WRITE_* bits. wb/wt pick write-back or write-through, wa/nwa
+ *     write-allocate or no-write-allocate. Returns -1 if malformed.
+ */
+static int parse_write_mode(const char *arg) {
+    char *copy = strdup(arg);
+    char *save;
+    int mode = 0;
+    for (char *item = strtok_r(copy, ",", &save); item != NULL;
+         item = strtok_r(NULL, ",", &save)) {
+        if (strcmp(item, "wb") == 0) {
+            mode &= ~WRITE_THROUGH;
+        }
+        else if (strcmp(item, "wt") == 0) {
+            mode |= WRITE_THROUGH;
+        }
+        else if (strcmp(item, "wa") == 0) {
+            mode &= ~WRITE_NO_ALLOCATE;
+        }
+        else if (strcmp(item, "nwa") == 0) {
+            mode |= WRITE_NO_ALLOCATE;
+        }
+        else {
+            mode = -1;
+            break;
+        }
+    }
+    free(copy);
+    return mode;
+}
+
+//Region of interest every trace is read through (-m, -l)
+static TraceFilter region;
+
+/*
+ * open_trace - Map (or stream) the trace or exit with an error
+ */
+static void open_trace(Trace *trace, const char *trace_file) {
+    //Safety
+    if (trace_file == NULL || trace_open(trace, trace_file) != 0) {
+        fprintf(stderr, "Error: Could not open file %s \n", trace_file);
+        exit(1);
+    }
+    trace->filter = &region;
+}
+
+/*
+ * run_stack_distance - Print the hits, misses and evictions of every LRU
+ *     associativity 1..max_ways for 2^s sets of 2^b bytes, all from one
+ *     pass over the trace
+ */
+int run_stack_distance(int s, int b, int max_ways, bool split, const char *trace_file) {
+    StackDist sd;
+    if (sd_init(&sd, s, b, max_ways) != 0) {
+        fprintf(stderr, "Error: Could not allocate stack distance engine for %llu sets of %d ways\n",
+                1ULL << s, max_ways);
         exit(1);
     }
 
+    Trace trace;
+    open_trace(&trace, trace_file);
+    TraceRecord rec;
+    while (trace_next(&trace, &rec)) {
+        //Every block the access spans when splitting, else just the first
+        uint64_t last = split && rec.size > 0 ? (rec.addr + rec.size - 1) >> b
+                                              : rec.addr >> b;
+        for (uint64_t block = rec.addr >> b; block <= last; block++) {
+            if (rec.op == 'M') {
+                sd_access(&sd, block << b);
+            }
+            sd_access(&sd, block << b);
+        }
+    }
+    trace_close(&trace);
+
+    printf("%4s %6s %4s %12s %12s %12s %9s\n",
+           "s", "E", "b", "hits", "misses", "evictions", "miss%");
+    for (int E = 1; E <= max_ways; E++) {
+        long hits, misses, evictions;
+        sd_counts(&sd, E, &hits, &misses, &evictions);
+        long total = hits + misses;
+        printf("%4d %6d %4d %12ld %12ld %12ld %9.3f\n",
+               s, E, b, hits, misses, evictions,
+               total ? 100.0 * misses / total : 0.0);
+    }
+    sd_free(&sd);
+    return 0;
+}
+
+/*
+ * run_hierarchy - Simulate a multi-level hierarchy built from the -L
+ *     level specs and print per-level statistics and the AMAT
+ */
+int run_hierarchy(char **specs, int nspecs, Inclusion inclusion,
+                  const Policy *policy, const char *trace_file) {
+    Hierarchy h;
+    hierarchy_init(&h, inclusion);
+    for (int i = 0; i < nspecs; i++) {
+        const char *why = hierarchy_add(&h, specs[i], policy);
+        if (why != NULL) {
+            fprintf(stderr, "Error: Bad level %s (%s)\n", specs[i], why);
+            exit(1);
+        }
+    }
+    const char *why = hierarchy_finish(&h);
+    if (why != NULL) {
+        fprintf(stderr, "Error: Hierarchy %s\n", why);
+        exit(1);
+    }
+
+    Trace trace;
+    open_trace(&trace, trace_file);
+    //Instruction fetches feed L1I
+    trace.ifetch = h.l1i != NULL;
+    TraceRecord rec;
+    while (trace_next(&trace, &rec)) {
+        hierarchy_simulate(&h, rec.op, rec.addr);
+    }
+    trace_close(&trace);
+
+    hierarchy_print(&h);
+    hierarchy_free(&h);
+    return 0;
+}
+
+/*
+ * run_coherence - Simulate one private cache per trace file, kept
+ *     coherent by protocol, interleaving the traces a record at a time
+ */
+int run_coherence(Protocol protocol, char **files, int nfiles, int s, int E,
+                  int b, const Policy *policy) {
+    Coherence co;
+    if (coherence_init(&co, protocol, nfiles, s, E, b, policy) != 0) {
+        fprintf(stderr, "Error: Could not allocate caches with s=%d E=%d b=%d\n", s, E, b);
+        exit(1);
+    }
+
+    Trace traces[MAX_CORES];
+    for (int i = 0; i < nfiles; i++) {
+        open_trace(&traces[i], files[i]);
+    }
+    TraceRecord rec;
+    int live = nfiles;
+    bool done[MAX_CORES] = {false};
+    while (live > 0) {
+        //Round-robin, one record per core per turn
+        for (int i = 0; i < nfiles; i++) {
+            if (done[i]) {
+                continue;
+            }
+            if (!trace_next(&traces[i], &rec)) {
+                done[i] = true;
+                live--;
+                continue;
+            }
+            coherence_access(&co, i, rec.op, rec.addr, rec.size);
+        }
+    }
+    for (int i = 0; i < nfiles; i++) {
+        trace_close(&traces[i]);
+    }
+
+    coherence_print(&co);
+    coherence_free(&co);
+    return 0;
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]) {
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("       %s -x <sweep> -t <file>\n", argv[0]);
+    printf("       %s -L <level> [-L <level> ...] [-i <inclusion>] -t <file>\n", argv[0]);
+    printf("       %s -M <protocol> -s <num> -E <num> -b <num> -c <file> -c <file> ...\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Optional verbose flag.\n");
+    printf("  -s <num>   Number of set index bits.\n");
+    printf("  -E <num>   Number of lines per set.\n");
+    printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -t <file>  Trace file (text or binary), - to stream it from stdin.\n");
+    printf("  -m <mark>  Only simulate the region between two marker addresses, given\n");
+    printf("             as start,end in hex or @file to read them from tracegen's .marker.\n");
+    printf("  -l         Only simulate addresses in the low 32-bit address space.\n");
+    printf("             -m can be given up to %d times, each region is simulated on\n", MAX_REGIONS);
+    printf("             its own caches.\n");
+    printf("  -I <range> Only simulate addresses in lo-hi (hex, hi excluded). Repeatable.\n");
+    printf("  -X <range> Do not simulate addresses in lo-hi (hex, hi excluded). Repeatable.\n");
+    printf("  -x <sweep> Simulate many s:E:b geometries in one pass over the trace.\n");
+    printf("             Fields take lists and ranges, e.g. 0-4:1/2/4:5,5:1:5\n");
+    printf("  -j <num>   Split the sets across this many worker threads.\n");
+    printf("  -p <name>  Replacement policy (default lru):\n");
+    for (int i = 0; policies[i] != NULL; i++) {
+        printf("               %-8s %s\n", policies[i]->name, policies[i]->description);
+    }
+    printf("  -w <mode>  Write policy, wb or wt plus wa or nwa (default wb,wa), and\n");
+    printf("             report writebacks and memory traffic.\n");
+    printf("  -P <pf>    Prefetcher kind[:degree[:latency]], kind next, stride or stream,\n");
+    printf("             latency counted in demand accesses (default degree 1, latency 4).\n");
+    printf("  -B         Split accesses spanning several blocks into one touch per block.\n");
+    printf("  -C         Classify misses as compulsory, capacity or conflict.\n");
+    printf("  -H <file>  Write per-set and per-region hits, misses and evictions to\n");
+    printf("             <file>, as JSON if it ends in .json and CSV otherwise.\n");
+    printf("  -R <num>   Heatmap regions of 2^<num> bytes (default %d).\n", DEFAULT_REGION_BITS);
+    printf("  -D <num>   With -s and -b, report every LRU associativity up to <num>\n");
+    printf("             from one stack distance pass.\n");
+    printf("  -L <level> Add a hierarchy level name:s:E:b:latency (l1i, l1d or unified\n");
+    printf("             l1 on top, other names chained below in order), or mem:latency.\n");
+    printf("  -i <incl>  Hierarchy inclusion: nine (default), incl or excl.\n");
+    printf("  -M <proto> Keep one private cache per -c trace coherent with mesi or moesi,\n");
+    printf("             reporting coherence misses and false sharing.\n");
+    printf("  -c <file>  Trace of one core for -M (up to %d), interleaved round-robin.\n", MAX_CORES);
+    printf("  -T <spec>  Also simulate a DTLB and STLB with page walks. Specs (repeatable)\n");
+    printf("             dtlb:entries:ways (default %d:%d), stlb:entries:ways (default\n",
+           TLB_DTLB_ENTRIES, TLB_DTLB_WAYS);
+    printf("             %d:%d, stlb:0 for none), page:4k, page:2m or page:1g and\n",
+           TLB_STLB_ENTRIES, TLB_STLB_WAYS);
+    printf("             walk:cycles per page table reference (default %d).\n", TLB_WALK_LATENCY);
+    printf("  -k <file>  Save the caches and trace position to <file> at the end.\n");
+    printf("  -K <num>   With -k, also save after about every <num> records.\n");
+    printf("  -r <file>  Resume from a -k checkpoint, same trace and options.\n");
+    printf("  -W <file>  Warm start: begin with a checkpoint's contents, counters at zero.\n");
+    printf("  -N <num>   Print hits, misses and evictions every <num> records.\n");
+    printf("  -S <spec>  Estimate from a sample with a 95%% confidence interval: sets:<n>\n");
+    printf("             simulates 1 in <n> sets, time:<period>:<window>[:<warm>] counts\n");
+    printf("             the last <window> records of every <period>, simulating only\n");
+    printf("             <warm> records before each window if given (else all).\n");
+    printf("\nExamples:\n");
+    printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  linux>  %s -x 0-8:1/2/4/8:4-6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -j 8 -s 12 -E 8 -b 6 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -p srrip -s 4 -E 16 -b 5 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -w wt,nwa -s 4 -E 2 -b 4 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -P stream:2:8 -s 5 -E 1 -b 5 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -C -s 5 -E 1 -b 5 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -T dtlb:32:4 -T page:2m -s 5 -E 1 -b 5 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -k run.ckpt -K 1000000 -s 10 -E 8 -b 6 -t big.trace\n", argv[0]);
+    printf("  linux>  %s -N 1000 -s 5 -E 1 -b 5 -t trace.f0\n", argv[0]);
+    printf("  linux>  %s -S sets:16 -s 10 -E 8 -b 6 -t big.trace\n", argv[0]);
+    printf("  linux>  %s -S time:100000:10000:20000 -s 10 -E 8 -b 6 -t big.trace\n", argv[0]);
+    printf("  linux>  valgrind --tool=lackey --trace-mem=yes --log-fd=1 ./tracegen -M 32 -N 32 -F 0 |\n");
+    printf("             %s -m @.marker -l -s 5 -E 1 -b 5 -t -\n", argv[0]);
+    printf("  linux>  %s -m 6020c0,6020c1 -m 6020c2,6020c3 -X 7f0000000000-800000000000\n", argv[0]);
+    printf("             -s 5 -E 1 -b 5 -t trace.tmp\n");
+    printf("  linux>  %s -H sets.csv -s 5 -E 1 -b 5 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -D 64 -s 0 -b 5 -t traces/long.trace\n", argv[0]);
+    printf("  linux>  %s -M moesi -s 6 -E 8 -b 6 -c core0.trace -c core1.trace\n", argv[0]);
+    printf("  linux>  %s -L l1i:6:8:6:4 -L l1d:6:8:6:4 -L l2:10:8:6:12 -L llc:13:16:6:40\n", argv[0]);
+    printf("             -L mem:200 -i incl -t traces/long.trace\n");
+}
+
+int main(int argc, char *argv[])
+{
     int opt;
     extern char *optarg;
-    int s, E, b;
+    int s = -1, E = -1, b = -1;
     bool verbose = false;
     char *trace_file = NULL;
+    char *sweep = NULL;
+    int nthreads = 1;
+    int max_ways = 0;
+    const Policy *policy = policies[0];
+    char *levels[MAX_LEVELS + 1];
+    int nlevels = 0;
+    Inclusion inclusion = NINE;
+    int write_mode = 0;
+    bool traffic = false;
+    char *prefetch = NULL;
+    bool split = false;
+    bool classify = false;
+    char *heatmap_file = NULL;
+    int region_bits = DEFAULT_REGION_BITS;
+    Tlb tlb;
+    bool use_tlb = false;
+    char *protocol = NULL;
+    char *core_files[MAX_CORES];
+    int ncores = 0;
+    char *checkpoint = NULL;
+    long checkpoint_every = 0;
+    char *resume = NULL;
+    char *warm = NULL;
+    char *sample = NULL;
+    long every = 0;
+    Sampler sampler;
+    const char *why;
+
+    trace_filter_init(&region);
+    tlb_init(&tlb);
 
     // Take in input args
-    while ((opt = getopt(argc, argv, "vs:E:b:t:")) != -1) {
+    while ((opt = getopt(argc, argv, "hvs:E:b:t:x:j:D:p:L:i:w:P:BCH:R:m:lI:X:T:M:c:k:K:r:W:S:N:")) != -1) {
         switch (opt) {
             case 'v':
                 verbose = true;
@@ -111,78 +731,571 @@ int main(int argc, char *argv[])
             case 't':
                 trace_file = optarg;
                 break;
+            case 'x':
+                sweep = optarg;
+                break;
+            case 'j':
+                nthreads = atoi(optarg);
+                break;
+            case 'D':
+                max_ways = atoi(optarg);
+                break;
+            case 'p':
+                policy = find_policy(optarg);
+                if (policy == NULL) {
+                    fprintf(stderr, "Error: Unknown replacement policy %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'L':
+                //One extra for mem
+                if (nlevels == MAX_LEVELS + 1) {
+                    fprintf(stderr, "Error: At most %d levels\n", MAX_LEVELS);
+                    exit(1);
+                }
+                levels[nlevels++] = optarg;
+                break;
+            case 'i':
+                if (strcmp(optarg, "nine") == 0) {
+                    inclusion = NINE;
+                }
+                else if (strcmp(optarg, "incl") == 0) {
+                    inclusion = INCLUSIVE;
+                }
+                else if (strcmp(optarg, "excl") == 0) {
+                    inclusion = EXCLUSIVE;
+                }
+                else {
+                    fprintf(stderr, "Error: Unknown inclusion %s (nine, incl or excl)\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'w':
+                write_mode = parse_write_mode(optarg);
+                if (write_mode < 0) {
+                    fprintf(stderr, "Error: Bad write policy %s (wb or wt, wa or nwa)\n", optarg);
+                    exit(1);
+                }
+                traffic = true;
+                break;
+            case 'P':
+                prefetch = optarg;
+                break;
+            case 'B':
+                split = true;
+                break;
+            case 'C':
+                classify = true;
+                break;
+            case 'H':
+                heatmap_file = optarg;
+                break;
+            case 'R':
+                region_bits = atoi(optarg);
+                if (region_bits < 0 || region_bits > 63) {
+                    fprintf(stderr, "Error: -R takes 0 to 63 bits\n");
+                    exit(1);
+                }
+                break;
+            case 'm':
+                if (trace_filter_markers(&region, optarg) != 0) {
+                    fprintf(stderr, "Error: Bad markers %s (start,end in hex or one @file, at most %d)\n",
+                            optarg, MAX_REGIONS);
+                    exit(1);
+                }
+                break;
+            case 'l':
+                region.low_only = 1;
+                break;
+            case 'I':
+            case 'X':
+                if (trace_filter_range(&region, optarg, opt == 'X') != 0) {
+                    fprintf(stderr, "Error: Bad address range %s (lo-hi in hex, at most %d)\n",
+                            optarg, MAX_RANGES);
+                    exit(1);
+                }
+                break;
+            case 'T':
+                why = tlb_set(&tlb, optarg);
+                if (why != NULL) {
+                    fprintf(stderr, "Error: Bad TLB spec %s (%s)\n", optarg, why);
+                    exit(1);
+                }
+                use_tlb = true;
+                break;
+            case 'M':
+                protocol = optarg;
+                break;
+            case 'c':
+                if (ncores == MAX_CORES) {
+                    fprintf(stderr, "Error: At most %d cores\n", MAX_CORES);
+                    exit(1);
+                }
+                core_files[ncores++] = optarg;
+                break;
+            case 'k':
+                checkpoint = optarg;
+                break;
+            case 'K':
+                checkpoint_every = atol(optarg);
+                if (checkpoint_every < 1) {
+                    fprintf(stderr, "Error: -K takes a positive number of records\n");
+                    exit(1);
+                }
+                break;
+            case 'r':
+                resume = optarg;
+                break;
+            case 'W':
+                warm = optarg;
+                break;
+            case 'N':
+                every = atol(optarg);
+                if (every < 1) {
+                    fprintf(stderr, "Error: -N takes a positive number of records\n");
+                    exit(1);
+                }
+                break;
+            case 'S':
+                sample = optarg;
+                why = sample_init(&sampler, sample);
+                if (why != NULL) {
+                    fprintf(stderr, "Error: Bad sampling %s (%s)\n", sample, why);
+                    exit(1);
+                }
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
         }
     }
 
-    //S = 2^s
-    uint64_t S = 1 << s;
+    if (nthreads < 1 || nthreads > MAX_THREADS) {
+        fprintf(stderr, "Error: -j takes 1 to %d threads\n", MAX_THREADS);
+        exit(1);
+    }
+    if (nthreads > 1 && verbose) {
+        fprintf(stderr, "Error: -v needs the serial simulator, drop -j\n");
+        exit(1);
+    }
+    //Prefetches cross sets, so they cannot be split across threads
+    if (prefetch != NULL && (nthreads > 1 || nlevels > 0 || max_ways != 0)) {
+        fprintf(stderr, "Error: -P cannot be combined with -j, -L or -D\n");
+        exit(1);
+    }
+    //The shadow cache sees every set
+    if (classify && (nthreads > 1 || nlevels > 0 || max_ways != 0)) {
+        fprintf(stderr, "Error: -C cannot be combined with -j, -L or -D\n");
+        exit(1);
+    }
+    //The TLB follows the trace on the main thread, in order
+    if (use_tlb && (nthreads > 1 || nlevels > 0 || max_ways != 0)) {
+        fprintf(stderr, "Error: -T cannot be combined with -j, -L or -D\n");
+        exit(1);
+    }
+    //One cache, one serial pass
+    if (heatmap_file != NULL &&
+        (nthreads > 1 || nlevels > 0 || max_ways != 0 || sweep != NULL)) {
+        fprintf(stderr, "Error: -H cannot be combined with -j, -L, -D or -x\n");
+        exit(1);
+    }
+
+    //Only the caches themselves are saved, by the serial simulator
+    if (checkpoint != NULL || resume != NULL || warm != NULL) {
+        if (nthreads > 1 || verbose || nlevels > 0 || max_ways != 0 ||
+            prefetch != NULL || classify || heatmap_file != NULL || use_tlb ||
+            protocol != NULL || ncores > 0) {
+            fprintf(stderr, "Error: -k, -r and -W cannot be combined with -j, -v, -L, -D, -P, -C, -H, -T or -M\n");
+            exit(1);
+        }
+        if (resume != NULL && warm != NULL) {
+            fprintf(stderr, "Error: -r and -W cannot be combined\n");
+            exit(1);
+        }
+    }
+    //Sampling drives a single plain cache one record at a time
+    if (sample != NULL &&
+        (sweep != NULL || nthreads > 1 || verbose || nlevels > 0 || max_ways != 0 ||
+         split || prefetch != NULL || classify || heatmap_file != NULL || use_tlb ||
+         protocol != NULL || ncores > 0 ||
+         checkpoint != NULL || resume != NULL || warm != NULL)) {
+        fprintf(stderr, "Error: -S cannot be combined with -x, -j, -v, -L, -D, -B, -P, -C, -H, -T, -M, -k, -r or -W\n");
+        exit(1);
+    }
+    //Rows come from the serial simulators, in trace order
+    if (every != 0 && (nthreads > 1 || nlevels > 0 || max_ways != 0 ||
+                       protocol != NULL || ncores > 0 || sample != NULL)) {
+        fprintf(stderr, "Error: -N cannot be combined with -j, -L, -D, -M or -S\n");
+        exit(1);
+    }
+    if (checkpoint_every != 0 && checkpoint == NULL) {
+        fprintf(stderr, "%s: -K needs -k\n", argv[0]);
+        exit(1);
+    }
 
-    //First initalise it based on our size
-    Line **cache = (Line **)malloc( S * sizeof(Line *));
+    //Several marker regions only work for the plain and sweep simulators,
+    //checked before the other modes take over
+    int nregions = trace_filter_regions(&region);
+    if (nregions > 1 && (protocol != NULL || ncores > 0 || nlevels > 0 ||
+                         max_ways != 0 || heatmap_file != NULL ||
+                         checkpoint != NULL || resume != NULL || warm != NULL ||
+                         sample != NULL)) {
+        fprintf(stderr, "Error: Several -m regions cannot be combined with -M, -L, -D, -H, -k, -r, -W or -S\n");
+        exit(1);
+    }
 
-    for (int i=0; i < S; i++) {
-        cache[i] = (Line *)malloc(E * sizeof(Line));
-        //Default init.
-        for (int j=0; j < E; j++) {
-            cache[i]->valid = 0;
-            cache[i]->tag = 0;
-            cache[i]->lru_stamp = 0;
+    //Several private caches, each with its own trace
+    if (protocol != NULL || ncores > 0) {
+        Protocol proto;
+        if (protocol == NULL || find_protocol(protocol, &proto) != 0) {
+            fprintf(stderr, "Error: -c needs -M mesi or -M moesi\n");
+            exit(1);
+        }
+        if (ncores == 0 || s < 0 || E < 1 || b < 0 || s + b >= 64) {
+            fprintf(stderr, "%s: -M needs -s, -E, -b and at least one -c\n", argv[0]);
+            exit(1);
+        }
+        if (trace_file != NULL || sweep != NULL || nthreads > 1 || verbose ||
+            nlevels > 0 || max_ways != 0 || write_mode != 0 || prefetch != NULL ||
+            split || classify || heatmap_file != NULL || use_tlb ||
+            region.nmarkers > 0) {
+            fprintf(stderr, "Error: -M cannot be combined with -t, -x, -j, -v, -L, -D, -w, -P, -B, -C, -H, -T or -m\n");
+            exit(1);
+        }
+        if (policy->check(E) != NULL) {
+            fprintf(stderr, "Error: Policy %s %s (E=%d)\n", policy->name, policy->check(E), E);
+            exit(1);
         }
+        return run_coherence(proto, core_files, ncores, s, E, b, policy);
     }
 
+    //The hierarchy has its own geometry per level
+    if (nlevels > 0) {
+        if (trace_file == NULL) {
+            fprintf(stderr, "%s: -L needs -t\n", argv[0]);
+            exit(1);
+        }
+        if (sweep != NULL || nthreads > 1 || verbose || max_ways != 0 ||
+            s >= 0 || E >= 0 || b >= 0 || write_mode != 0 || split) {
+            fprintf(stderr, "Error: -L cannot be combined with -s, -E, -b, -x, -j, -v, -w, -B or -D\n");
+            exit(1);
+        }
+        return run_hierarchy(levels, nlevels, inclusion, policy, trace_file);
+    }
 
-    //Open trace for processing
+    //The stack distance engine replaces the cache entirely
+    if (max_ways != 0) {
+        if (max_ways < 0 || s < 0 || b < 0 || s + b >= 64 || trace_file == NULL) {
+            fprintf(stderr, "%s: -D needs -s, -b and -t\n", argv[0]);
+            exit(1);
+        }
+        if (sweep != NULL || nthreads > 1 || verbose || policy != policies[0] ||
+            write_mode != 0) {
+            fprintf(stderr, "Error: -D cannot be combined with -x, -j, -v, -p or -w\n");
+            exit(1);
+        }
+        return run_stack_distance(s, b, max_ways, split, trace_file);
+    }
 
-    FILE *traceFile = fopen(trace_file, "r");
+    //Work out which geometries we are simulating
+    static Geometry geoms[MAX_CONFIGS];
+    int nconfigs;
+    if (sweep != NULL) {
+        nconfigs = parse_sweep(sweep, geoms, MAX_CONFIGS);
+        if (nconfigs <= 0) {
+            fprintf(stderr, "Error: Bad sweep %s (at most %d geometries)\n", sweep, MAX_CONFIGS);
+            exit(1);
+        }
+        //One line of output per access makes no sense for a table
+        verbose = false;
+    }
+    else {
+        if (s < 0 || E < 1 || b < 0 || trace_file == NULL) {
+            fprintf(stderr, "%s: Missing required command line argument\n", argv[0]);
+            usage(argv);
+            exit(1);
+        }
+        geoms[0].s = s;
+        geoms[0].E = E;
+        geoms[0].b = b;
+        nconfigs = 1;
+    }
 
-    //Safety
-    if (traceFile == NULL) {
-        fprintf(stderr, "Error: Could not open file %s \n", trace_file);
+    //First initalise them based on our size, one arena per cache. Each
+    //marker region gets its own copy of every geometry
+    int ncaches = nconfigs * nregions;
+    Cache *caches = calloc(ncaches, sizeof(Cache));
+    for (int i = 0; i < ncaches; i++) {
+        Geometry *g = &geoms[i % nconfigs];
+        why = g->E >= 1 ? policy->check(g->E) : NULL;
+        if (why != NULL) {
+            fprintf(stderr, "Error: Policy %s %s (E=%d)\n", policy->name, why, g->E);
+            exit(1);
+        }
+        if (g->E < 1 || g->s + g->b >= 64 ||
+            init_cache(&caches[i], g->s, g->E, g->b, policy) != 0) {
+            fprintf(stderr, "Error: Could not allocate cache with s=%d E=%d b=%d\n", g->s, g->E, g->b);
+            exit(1);
+        }
+        caches[i].write_mode = write_mode;
+        caches[i].split = split;
+    }
+
+    //One prefetcher per cache, each trains on its own misses
+    Prefetcher *prefetchers = NULL;
+    if (prefetch != NULL) {
+        prefetchers = calloc(ncaches, sizeof(Prefetcher));
+        for (int i = 0; i < ncaches; i++) {
+            if (prefetch_init(&prefetchers[i], prefetch) != 0) {
+                fprintf(stderr, "Error: Bad prefetcher %s (next, stride or stream[:degree[:latency]])\n", prefetch);
+                exit(1);
+            }
+            caches[i].prefetcher = &prefetchers[i];
+        }
+    }
+
+    //Each cache gets a fully associative shadow of its own size
+    Classifier *classifiers = NULL;
+    if (classify) {
+        classifiers = calloc(ncaches, sizeof(Classifier));
+        for (int i = 0; i < ncaches; i++) {
+            if (classify_init(&classifiers[i], &caches[i]) != 0) {
+                fprintf(stderr, "Error: Could not allocate shadow cache for s=%d E=%d b=%d\n",
+                        caches[i].s, caches[i].E, caches[i].b);
+                exit(1);
+            }
+            caches[i].classifier = &classifiers[i];
+        }
+    }
+
+
+    Heatmap heatmap;
+    FILE *heatmap_fp = NULL;
+    if (heatmap_file != NULL) {
+        heatmap_fp = fopen(heatmap_file, "w");
+        if (heatmap_fp == NULL) {
+            fprintf(stderr, "Error: Could not open file %s \n", heatmap_file);
+            exit(1);
+        }
+        if (heatmap_init(&heatmap, &caches[0], region_bits) != 0) {
+            fprintf(stderr, "Error: Could not allocate heatmap\n");
+            exit(1);
+        }
+        caches[0].heatmap = &heatmap;
+    }
+
+    if (use_tlb && (why = tlb_finish(&tlb)) != NULL) {
+        fprintf(stderr, "Error: TLB %s\n", why);
         exit(1);
     }
 
-    // Trace arguments
-    uint64_t setIdx;
-    uint64_t tag;
-    char operation;
-    uint64_t address;
-    int size;
-    //Scaning
-    while (fscanf(traceFile, " %c %lx,%d", &operation, &address, &size) > 0 ) {
+    //Open trace for processing, it is mapped (or streamed from a pipe)
+    //rather than read through stdio. Text and binary (trace2bin) traces
+    //are both accepted
+    Trace trace;
+    open_trace(&trace, trace_file);
 
-        setIdx = (address >> b) & ( S-1 );
-        tag = (address >> (b+s));
-        //printf("%c %lx -> Set Index: %lu, Tag: %lu\n", operation, address, setIdx, tag);
+    //Pick up where a checkpoint left off, or start from its contents
+    if (resume != NULL || warm != NULL) {
+        TracePos pos;
+        const char *file = resume != NULL ? resume : warm;
+        why = checkpoint_load(file, caches, ncaches, resume != NULL ? &pos : NULL);
+        if (why != NULL) {
+            fprintf(stderr, "Error: Checkpoint %s %s\n", file, why);
+            exit(1);
+        }
+        if (resume != NULL && trace_seek(&trace, &pos) != 0) {
+            fprintf(stderr, "Error: Checkpoint %s is past the end of %s\n", resume, trace_file);
+            exit(1);
+        }
+    }
 
-        if (verbose) {
-            printf("%c %lx,%lu ", operation, address, setIdx);
+    //Estimate from part of the trace instead of the full run
+    if (sample != NULL) {
+        why = sample_run(&sampler, &caches[0], &trace);
+        if (why != NULL) {
+            fprintf(stderr, "Error: Sampling %s %s\n", sample, why);
+            exit(1);
         }
+        trace_close(&trace);
+        sample_print(&sampler);
+        sample_free(&sampler);
+        free_cache(&caches[0]);
+        free(caches);
+        return 0;
+    }
 
-        if (operation == 'I') {
-            //We are only simulating d-cache and not i-cache
-            continue;
+    //Deltas every so many records, ahead of the totals
+    Series series;
+    Series *seriesp = NULL;
+    if (every != 0) {
+        series.every = every;
+        //Rows of a resumed run stay numbered from the start of the trace
+        series.records = trace.records;
+        series.nconfigs = nconfigs;
+        series.nregions = nregions;
+        series.last = calloc(ncaches, sizeof(Snapshot));
+        if (series.last == NULL) {
+            fprintf(stderr, "Error: Out of memory for -N\n");
+            exit(1);
         }
-        else if (operation == 'S') {
-            //Store
-            access_cache(cache, &E, &setIdx, &tag, &verbose);
+        //A resumed run carries on from the checkpoint's totals
+        for (int i = 0; i < ncaches; i++) {
+            series.last[i].hits = caches[i].hits;
+            series.last[i].misses = caches[i].misses;
+            series.last[i].evictions = caches[i].evictions;
         }
-        else if (operation == 'L') {
-            //Load
-            access_cache(cache, &E, &setIdx, &tag, &verbose);
+        seriesp = &series;
+        series_header(seriesp);
+    }
+
+    TraceRecord rec;
+    //Scaning, I lines never make it out of trace_next()
+    if (nthreads > 1) {
+        simulate_parallel(caches, ncaches, nconfigs, &trace, nthreads);
+    }
+    else if (!verbose && nregions == 1) {
+        simulate_serial(caches, ncaches, use_tlb ? &tlb : NULL, &trace,
+                        checkpoint, checkpoint_every, seriesp);
+    }
+    else while (trace_next(&trace, &rec)) {
+        if (verbose) {
+            printf("%c %lx,%d ", rec.op, rec.addr, rec.size);
         }
-        else if (operation == 'M') {
-            //E.G. Load then Store
-            access_cache(cache, &E, &setIdx, &tag, &verbose);
-            access_cache(cache, &E, &setIdx, &tag, &verbose);
+
+        //Every geometry of the record's regions sees it while it is still hot
+        for (int i = 0; i < ncaches; i++) {
+            if ((rec.regions >> (i / nconfigs)) & 1) {
+                if (verbose) {
+                    simulate_verbose(&caches[i], rec.op, rec.addr, rec.size);
+                }
+                else {
+                    simulate(&caches[i], rec.op, rec.addr, rec.size);
+                }
+            }
+        }
+
+        if (use_tlb) {
+            tlb_access(&tlb, rec.addr, rec.size);
         }
 
         if (verbose) {
             printf("\n");
         }
+
+        if (seriesp != NULL) {
+            series_count(seriesp, caches, ncaches, 1);
+        }
     }
+    trace_close(&trace);
 
+    if (seriesp != NULL) {
+        //The last, partial interval
+        if (series.records % every != 0) {
+            series_row(seriesp, caches, ncaches);
+        }
+        free(series.last);
+        printf("\n");
+    }
 
-    printSummary(hit, miss, eviction);
+    if (sweep != NULL || nregions > 1) {
+        //One row per cache, led by its region if there are several
+        print_region(nregions, -1);
+        printf("%4s %6s %4s %12s %12s %12s %9s %12s %14s %10s\n",
+               "s", "E", "b", "hits", "misses", "evictions", "miss%",
+               "writebacks", "memory-bytes", "split");
+        for (int i = 0; i < ncaches; i++) {
+            Cache *c = &caches[i];
+            long total = c->hits + c->misses;
+            print_region(nregions, i / nconfigs);
+            printf("%4d %6d %4d %12ld %12ld %12ld %9.3f %12ld %14lu %10ld\n",
+                   c->s, c->E, c->b, c->hits, c->misses, c->evictions,
+                   total ? 100.0 * c->misses / total : 0.0, c->writebacks,
+                   read_traffic(c) + write_traffic(c), c->split_accesses);
+        }
+        if (classifiers != NULL) {
+            printf("\n");
+            print_region(nregions, -1);
+            printf("%4s %6s %4s %12s %12s %12s\n",
+                   "s", "E", "b", "compulsory", "capacity", "conflict");
+            for (int i = 0; i < ncaches; i++) {
+                Cache *c = &caches[i];
+                Classifier *cl = &classifiers[i];
+                print_region(nregions, i / nconfigs);
+                printf("%4d %6d %4d %12ld %12ld %12ld\n", c->s, c->E, c->b,
+                       cl->compulsory, cl->capacity, cl->conflict);
+            }
+        }
+        if (prefetchers != NULL) {
+            printf("\n");
+            print_region(nregions, -1);
+            printf("%4s %6s %4s %12s %12s %12s %12s %12s\n",
+                   "s", "E", "b", "prefetches", "useful", "late", "polluting", "unused");
+            for (int i = 0; i < ncaches; i++) {
+                Cache *c = &caches[i];
+                Prefetcher *pf = &prefetchers[i];
+                print_region(nregions, i / nconfigs);
+                printf("%4d %6d %4d %12ld %12ld %12ld %12ld %12ld\n",
+                       c->s, c->E, c->b, pf->issued, c->prefetch_hits, pf->late,
+                       pf->polluting, c->prefetch_unused);
+            }
+        }
+        //The TLB saw every record once, whatever the cache geometry
+        if (use_tlb) {
+            printf("\n");
+            tlb_print(&tlb);
+        }
+    }
+    else {
+        Cache *c = &caches[0];
+        printSummary(c->hits, c->misses, c->evictions);
+        //Memory traffic if a write policy was asked for, lines still
+        //dirty at the end are not written back
+        if (traffic) {
+            printf("writebacks:%ld write-throughs:%ld memory-read-bytes:%lu memory-write-bytes:%lu\n",
+                   c->writebacks, c->direct_writes, read_traffic(c), write_traffic(c));
+        }
+        if (split) {
+            printf("split-accesses:%ld\n", c->split_accesses);
+        }
+        if (classifiers != NULL) {
+            Classifier *cl = &classifiers[0];
+            printf("compulsory:%ld capacity:%ld conflict:%ld\n",
+                   cl->compulsory, cl->capacity, cl->conflict);
+        }
+        if (prefetchers != NULL) {
+            Prefetcher *pf = &prefetchers[0];
+            printf("prefetches:%ld useful:%ld late:%ld polluting:%ld unused:%ld\n",
+                   pf->issued, c->prefetch_hits, pf->late, pf->polluting,
+                   c->prefetch_unused);
+        }
+        if (use_tlb) {
+            tlb_print(&tlb);
+        }
+    }
+
+    //The heatmap reads its cache's geometry, write it while the cache is live
+    if (heatmap_fp != NULL) {
+        size_t len = strlen(heatmap_file);
+        bool json = len >= 5 && strcmp(heatmap_file + len - 5, ".json") == 0;
+        heatmap_write(&heatmap, &caches[0], heatmap_fp, json);
+        fclose(heatmap_fp);
+        heatmap_free(&heatmap);
+    }
+    for (int i = 0; i < ncaches; i++) {
+        free_cache(&caches[i]);
+    }
+    for (int i = 0; classifiers != NULL && i < ncaches; i++) {
+        classify_free(&classifiers[i]);
+    }
+    if (use_tlb) {
+        tlb_free(&tlb);
+    }
+    free(caches);
+    free(prefetchers);
+    free(classifiers);
     return 0;
 }
-
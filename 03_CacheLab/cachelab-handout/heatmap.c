@@ -0,0 +1,155 @@
+/*
+ * heatmap.c - Per-set and per-region hit/miss/eviction tables
+ *
+ * Sets are a flat array indexed like the cache. Regions touched by the
+ * trace go in an open addressed table that doubles when half full, and
+ * are sorted by address only when written out.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "heatmap.h"
+
+static inline uint64_t hash_region(uint64_t region) {
+    region *= 0x9e3779b97f4a7c15ULL;
+    return region ^ (region >> 29);
+}
+
+/* Slot holding region, or the empty slot where it belongs */
+static uint64_t find_slot(const uint64_t *keys, uint64_t mask, uint64_t region) {
+    uint64_t i = hash_region(region) & mask;
+    while (keys[i] != 0 && keys[i] != region + 1) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow(Heatmap *hm) {
+    uint64_t size = (hm->mask + 1) * 2;
+    uint64_t *keys = calloc(size, sizeof(uint64_t));
+    Counts *regions = calloc(size, sizeof(Counts));
+    if (keys == NULL || regions == NULL) {
+        free(keys);
+        free(regions);
+        return -1;
+    }
+    for (uint64_t i = 0; i <= hm->mask; i++) {
+        if (hm->keys[i] != 0) {
+            uint64_t j = find_slot(keys, size - 1, hm->keys[i] - 1);
+            keys[j] = hm->keys[i];
+            regions[j] = hm->regions[i];
+        }
+    }
+    free(hm->keys);
+    free(hm->regions);
+    hm->keys = keys;
+    hm->regions = regions;
+    hm->mask = size - 1;
+    return 0;
+}
+
+int heatmap_init(Heatmap *hm, const Cache *cache, int region_bits) {
+    memset(hm, 0, sizeof(*hm));
+    hm->region_bits = region_bits;
+    hm->mask = 1023;
+    hm->sets = calloc(cache->S, sizeof(Counts));
+    hm->keys = calloc(hm->mask + 1, sizeof(uint64_t));
+    hm->regions = calloc(hm->mask + 1, sizeof(Counts));
+    if (hm->sets == NULL || hm->keys == NULL || hm->regions == NULL) {
+        heatmap_free(hm);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void count(Counts *c, int result) {
+    if (result == CACHE_HIT) {
+        c->hits++;
+        return;
+    }
+    c->misses++;
+    if (result == CACHE_MISS_EVICT) {
+        c->evictions++;
+    }
+}
+
+void heatmap_access(Heatmap *hm, Cache *cache, uint64_t addr, int result) {
+    count(&hm->sets[(addr >> cache->b) & (cache->S - 1)], result);
+
+    uint64_t region = addr >> hm->region_bits;
+    uint64_t slot = find_slot(hm->keys, hm->mask, region);
+    if (hm->keys[slot] == 0) {
+        hm->keys[slot] = region + 1;
+        //Keep the table at most half full
+        if (++hm->nregions * 2 > hm->mask + 1) {
+            if (grow(hm) != 0) {
+                fprintf(stderr, "Error: Out of memory for the region heatmap\n");
+                exit(1);
+            }
+            slot = find_slot(hm->keys, hm->mask, region);
+        }
+    }
+    count(&hm->regions[slot], result);
+}
+
+static int by_key(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void heatmap_write(Heatmap *hm, const Cache *cache, FILE *fp, bool json) {
+    //Occupied slots in address order
+    uint64_t *order = malloc((hm->nregions + 1) * sizeof(uint64_t));
+    if (order == NULL) {
+        fprintf(stderr, "Error: Out of memory for the region heatmap\n");
+        exit(1);
+    }
+    uint64_t n = 0;
+    for (uint64_t i = 0; i <= hm->mask; i++) {
+        if (hm->keys[i] != 0) {
+            order[n++] = hm->keys[i];
+        }
+    }
+    qsort(order, n, sizeof(uint64_t), by_key);
+
+    if (json) {
+        fprintf(fp, "{\n  \"s\": %d, \"E\": %d, \"b\": %d, \"region_bits\": %d,\n",
+                cache->s, cache->E, cache->b, hm->region_bits);
+        fprintf(fp, "  \"sets\": [\n");
+        for (uint64_t i = 0; i < cache->S; i++) {
+            Counts *c = &hm->sets[i];
+            fprintf(fp, "    {\"set\": %" PRIu64 ", \"hits\": %ld, \"misses\": %ld, \"evictions\": %ld}%s\n",
+                    i, c->hits, c->misses, c->evictions, i + 1 < cache->S ? "," : "");
+        }
+        fprintf(fp, "  ],\n  \"regions\": [\n");
+        for (uint64_t i = 0; i < n; i++) {
+            Counts *c = &hm->regions[find_slot(hm->keys, hm->mask, order[i] - 1)];
+            fprintf(fp, "    {\"base\": \"0x%" PRIx64 "\", \"hits\": %ld, \"misses\": %ld, \"evictions\": %ld}%s\n",
+                    (order[i] - 1) << hm->region_bits, c->hits, c->misses,
+                    c->evictions, i + 1 < n ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+    }
+    else {
+        fprintf(fp, "kind,index,hits,misses,evictions\n");
+        for (uint64_t i = 0; i < cache->S; i++) {
+            Counts *c = &hm->sets[i];
+            fprintf(fp, "set,%" PRIu64 ",%ld,%ld,%ld\n", i, c->hits, c->misses, c->evictions);
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            Counts *c = &hm->regions[find_slot(hm->keys, hm->mask, order[i] - 1)];
+            fprintf(fp, "region,0x%" PRIx64 ",%ld,%ld,%ld\n",
+                    (order[i] - 1) << hm->region_bits, c->hits, c->misses, c->evictions);
+        }
+    }
+    free(order);
+}
+
+void heatmap_free(Heatmap *hm) {
+    free(hm->sets);
+    free(hm->keys);
+    free(hm->regions);
+    hm->sets = NULL;
+    hm->keys = NULL;
+    hm->regions = NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ * heatmap.h - Per-set and per-address-region access counts
+ *
+ * Every demand access is charged to its cache set and to the aligned
+ * region of 2^region_bits bytes holding its address (4KB pages by
+ * default), then both tables are written out as CSV or JSON.
+ */
+#ifndef CSIM_HEATMAP_H
+#define CSIM_HEATMAP_H
+
+#include <stdio.h>
+#include "cache.h"
+
+#define DEFAULT_REGION_BITS 12
+
+typedef struct {
+    long hits;
+    long misses;
+    long evictions;
+} Counts;
+
+struct Heatmap {
+    int region_bits;
+    Counts *sets;           /* one per cache set */
+    uint64_t *keys;         /* open addressed region number + 1, 0 if empty */
+    Counts *regions;        /* counts of the region in the same slot */
+    uint64_t mask;
+    uint64_t nregions;
+};
+
+/* Set up empty tables for cache. Returns 0 on success, -1 on error */
+int heatmap_init(Heatmap *hm, const Cache *cache, int region_bits);
+
+/* Called after every demand access of cache (see simulate()) */
+void heatmap_access(Heatmap *hm, Cache *cache, uint64_t addr, int result);
+
+/* Write both tables as JSON if json is set, otherwise as CSV */
+void heatmap_write(Heatmap *hm, const Cache *cache, FILE *fp, bool json);
+
+void heatmap_free(Heatmap *hm);
+
+#endif /* CSIM_HEATMAP_H */
@@ -0,0 +1,271 @@
+/*
+ * hierarchy.c - Multi-level cache hierarchy built from simulated caches
+ *
+ * Lines pushed out of a level are handled by evicted(): under an
+ * inclusive policy they first back-invalidate every copy above, then
+ * dirty lines (or, for an exclusive hierarchy, every line) move down to
+ * the next level with insert_block(), which can cascade further.
+ * A writeback that finds its block already below counts as a use of
+ * it there (insert_block() goes through the policy's on_hit), as a
+ * write to the line would.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hierarchy.h"
+
+#define DEFAULT_MEM_LATENCY 100
+
+enum { INSTR, DATA };
+
+void hierarchy_init(Hierarchy *h, Inclusion inclusion) {
+    memset(h, 0, sizeof(*h));
+    h->inclusion = inclusion;
+    h->mem_latency = DEFAULT_MEM_LATENCY;
+}
+
+const char *hierarchy_add(Hierarchy *h, const char *spec, const Policy *policy) {
+    char name[LEVEL_NAME_LEN];
+    int s, E, b, latency;
+    int n = sscanf(spec, "%7[^:]:%d:%d:%d:%d", name, &s, &E, &b, &latency);
+
+    if (n >= 1 && strcmp(name, "mem") == 0) {
+        if (n != 2 || s < 0) {
+            return "memory takes mem:<latency>";
+        }
+        h->mem_latency = s;
+        return NULL;
+    }
+    if (n != 5) {
+        return "levels take name:s:E:b:latency";
+    }
+    if (s < 0 || b < 0 || E < 1 || s + b >= 64 || latency < 0) {
+        return "bad level geometry";
+    }
+    if (h->nlevels == MAX_LEVELS) {
+        return "too many levels";
+    }
+    for (int i = 0; i < h->nlevels; i++) {
+        if (strcmp(h->levels[i].name, name) == 0) {
+            return "level given twice";
+        }
+    }
+    if (policy->check(E) != NULL) {
+        return policy->check(E);
+    }
+
+    Level *lv = &h->levels[h->nlevels];
+    memset(lv, 0, sizeof(*lv));
+    strcpy(lv->name, name);
+    lv->latency = latency;
+    if (init_cache(&lv->cache, s, E, b, policy) != 0) {
+        return "could not allocate level";
+    }
+    h->nlevels++;
+    return NULL;
+}
+
+const char *hierarchy_finish(Hierarchy *h) {
+    Level *chain[MAX_LEVELS];
+    int nchain = 0;
+
+    h->l1i = h->l1d = NULL;
+    for (int i = 0; i < h->nlevels; i++) {
+        Level *lv = &h->levels[i];
+        if (strcmp(lv->name, "l1i") == 0) {
+            h->l1i = lv;
+        }
+        else if (strcmp(lv->name, "l1d") == 0 || strcmp(lv->name, "l1") == 0) {
+            if (h->l1d != NULL) {
+                return "l1 and l1d cannot both be given";
+            }
+            h->l1d = lv;
+            if (strcmp(lv->name, "l1") == 0) {
+                //Unified, takes instructions too
+                h->l1i = lv;
+            }
+        }
+        else {
+            chain[nchain++] = lv;
+        }
+    }
+    if (h->l1d == NULL) {
+        return "needs an l1d (or unified l1) level";
+    }
+    if (h->l1i != NULL && h->l1i != h->l1d && strcmp(h->l1d->name, "l1") == 0) {
+        return "l1 and l1i cannot both be given";
+    }
+
+    for (int i = 0; i < nchain; i++) {
+        chain[i]->depth = i + 1;
+        chain[i]->next = i + 1 < nchain ? chain[i + 1] : NULL;
+    }
+    h->l1d->next = nchain > 0 ? chain[0] : NULL;
+    if (h->l1i != NULL) {
+        h->l1i->next = h->l1d->next;
+    }
+    return NULL;
+}
+
+static void evicted(Hierarchy *h, Level *lv, Evicted *ev);
+
+/* Hand a block evicted from the level above to lv (or memory) */
+static void push_down(Hierarchy *h, Level *lv, uint64_t addr, bool dirty) {
+    if (lv == NULL) {
+        if (dirty) {
+            h->mem_writes++;
+        }
+        return;
+    }
+    Evicted ev;
+    insert_block(&lv->cache, addr, dirty, &ev);
+    evicted(h, lv, &ev);
+}
+
+static void evicted(Hierarchy *h, Level *lv, Evicted *ev) {
+    if (!ev->valid) {
+        return;
+    }
+    bool dirty = ev->dirty;
+
+    if (h->inclusion == INCLUSIVE && lv->depth > 0) {
+        //Remove every copy above, a dirty one makes this line dirty
+        uint64_t end = ev->addr + ((uint64_t)1 << lv->cache.b);
+        for (int i = 0; i < h->nlevels; i++) {
+            Level *up = &h->levels[i];
+            if (up->depth >= lv->depth) {
+                continue;
+            }
+            uint64_t step = (uint64_t)1 << up->cache.b;
+            for (uint64_t a = ev->addr & ~(step - 1); a < end; a += step) {
+                bool d;
+                if (invalidate_block(&up->cache, a, &d)) {
+                    lv->back_invalidations++;
+                    dirty |= d;
+                }
+            }
+        }
+    }
+
+    if (h->inclusion == EXCLUSIVE || dirty) {
+        push_down(h, lv->next, ev->addr, dirty);
+    }
+}
+
+/* One demand access starting at l1 */
+static void demand(Hierarchy *h, Level *l1, uint64_t addr, bool write, int kind) {
+    uint64_t cycles = l1->latency;
+    int flags = write ? CACHE_WRITE : 0;
+    bool from_memory = true;
+    Evicted ev;
+
+    h->demand[kind]++;
+    if (h->inclusion != EXCLUSIVE) {
+        //Every level on the way down is filled
+        Level *filled[MAX_LEVELS];
+        Evicted evs[MAX_LEVELS];
+        int n = 0;
+        for (Level *lv = l1; lv != NULL; lv = lv->next) {
+            if (lv != l1) {
+                cycles += lv->latency;
+            }
+            filled[n] = lv;
+            int result = access_block(&lv->cache, addr, flags, &evs[n++]);
+            if (result == CACHE_HIT) {
+                from_memory = false;
+                break;
+            }
+            //Lower levels are filled by a read
+            flags = 0;
+        }
+        //Then the victims, bottom up, so none lands below before the
+        //demanded block is there and pushes it (and, inclusive, its copy
+        //just filled above) back out
+        while (n-- > 0) {
+            evicted(h, filled[n], &evs[n]);
+        }
+    }
+    else if (access_block(&l1->cache, addr, flags, &ev) != CACHE_HIT) {
+        //Only L1 is filled, a lower level that has the block gives it up
+        for (Level *lv = l1->next; lv != NULL; lv = lv->next) {
+            Evicted none;
+            cycles += lv->latency;
+            if (access_block(&lv->cache, addr, CACHE_NO_ALLOC, &none) == CACHE_HIT) {
+                bool dirty;
+                invalidate_block(&lv->cache, addr, &dirty);
+                if (dirty) {
+                    insert_block(&l1->cache, addr, true, &none);
+                }
+                from_memory = false;
+                break;
+            }
+        }
+        //The L1 victim moves down
+        evicted(h, l1, &ev);
+    }
+    else {
+        from_memory = false;
+    }
+
+    if (from_memory) {
+        cycles += h->mem_latency;
+        h->mem_reads++;
+    }
+    h->cycles[kind] += cycles;
+}
+
+void hierarchy_simulate(Hierarchy *h, char op, uint64_t addr) {
+    switch (op) {
+        case 'I':
+            if (h->l1i != NULL) {
+                demand(h, h->l1i, addr, false, INSTR);
+            }
+            break;
+        case 'L':
+            demand(h, h->l1d, addr, false, DATA);
+            break;
+        case 'S':
+            demand(h, h->l1d, addr, true, DATA);
+            break;
+        case 'M':
+            demand(h, h->l1d, addr, false, DATA);
+            demand(h, h->l1d, addr, true, DATA);
+            break;
+    }
+}
+
+static double ratio(double num, double den) {
+    return den ? num / den : 0.0;
+}
+
+void hierarchy_print(Hierarchy *h) {
+    static const char *const names[] = {"nine", "inclusive", "exclusive"};
+
+    printf("%-6s %3s %5s %3s %4s %11s %11s %11s %11s %11s %9s %8s\n",
+           "level", "s", "E", "b", "lat", "accesses", "hits", "misses",
+           "evictions", "writebacks", "back-inv", "miss%");
+    for (int i = 0; i < h->nlevels; i++) {
+        Level *lv = &h->levels[i];
+        Cache *c = &lv->cache;
+        long accesses = c->hits + c->misses;
+        printf("%-6s %3d %5d %3d %4d %11ld %11ld %11ld %11ld %11ld %9ld %8.3f\n",
+               lv->name, c->s, c->E, c->b, lv->latency, accesses, c->hits,
+               c->misses, c->evictions, c->writebacks, lv->back_invalidations,
+               100.0 * ratio(c->misses, accesses));
+    }
+    printf("policy:%s memory latency:%d reads:%ld writes:%ld\n",
+           names[h->inclusion], h->mem_latency, h->mem_reads, h->mem_writes);
+    printf("AMAT (cycles): instruction:%.2f data:%.2f overall:%.2f\n",
+           ratio(h->cycles[INSTR], h->demand[INSTR]),
+           ratio(h->cycles[DATA], h->demand[DATA]),
+           ratio(h->cycles[INSTR] + h->cycles[DATA],
+                 h->demand[INSTR] + h->demand[DATA]));
+}
+
+void hierarchy_free(Hierarchy *h) {
+    for (int i = 0; i < h->nlevels; i++) {
+        free_cache(&h->levels[i].cache);
+    }
+    h->nlevels = 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * hierarchy.h - Multi-level cache hierarchy built from simulated caches
+ *
+ * Split L1I/L1D (or a unified L1) sit on top of a chain of lower levels
+ * (L2, LLC, ...) in front of memory. Instruction fetches start at L1I,
+ * loads and stores at L1D. Levels are expected to share a block size;
+ * back-invalidation covers every upper block inside an evicted one.
+ */
+#ifndef CSIM_HIERARCHY_H
+#define CSIM_HIERARCHY_H
+
+#include "cache.h"
+
+#define MAX_LEVELS 8
+#define LEVEL_NAME_LEN 8
+
+typedef enum {
+    NINE,       /* non-inclusive non-exclusive: fill every level, no back-invalidation */
+    INCLUSIVE,  /* lower levels hold everything above, evictions back-invalidate */
+    EXCLUSIVE   /* a block lives in one level, lower levels are victim caches */
+} Inclusion;
+
+typedef struct Level Level;
+
+struct Level {
+    char name[LEVEL_NAME_LEN];
+    Cache cache;
+    int latency;            /* cycles to look up this level */
+    int depth;              /* 0 for L1s, then 1, 2, ... down the chain */
+    Level *next;            /* level misses go to, NULL for memory */
+    long back_invalidations;/* lines this level's evictions removed above */
+};
+
+typedef struct {
+    Level levels[MAX_LEVELS];
+    int nlevels;
+    Level *l1i;             /* NULL: instruction fetches are ignored */
+    Level *l1d;
+    Inclusion inclusion;
+    int mem_latency;
+    long mem_reads;         /* blocks read from memory */
+    long mem_writes;        /* dirty blocks written to memory */
+    long demand[2];         /* instruction and data accesses */
+    uint64_t cycles[2];     /* their total latency */
+} Hierarchy;
+
+/* Start an empty hierarchy, memory latency defaults to 100 cycles */
+void hierarchy_init(Hierarchy *h, Inclusion inclusion);
+
+/*
+ * Add a level from a spec "name:s:E:b:latency". Names l1i and l1d make
+ * split L1s, l1 a unified one, and any other name is appended to the
+ * chain below L1 in the order given. "mem:latency" sets the memory
+ * latency. Returns NULL on success, otherwise an error message.
+ */
+const char *hierarchy_add(Hierarchy *h, const char *spec, const Policy *policy);
+
+/* Link the levels once all are added. Returns NULL or an error message */
+const char *hierarchy_finish(Hierarchy *h);
+
+/* Apply one trace record ('I', 'L', 'S' or 'M') */
+void hierarchy_simulate(Hierarchy *h, char op, uint64_t addr);
+
+/* Per-level table and average memory access time */
+void hierarchy_print(Hierarchy *h);
+
+void hierarchy_free(Hierarchy *h);
+
+#endif /* CSIM_HIERARCHY_H */
@@ -0,0 +1,139 @@
+/*
+ * kernel.c - Simulators specialized at compile time for common geometries
+ *
+ * One lru simulation body is written once as an always-inline function
+ * taking s, E and b as arguments, and KERNEL() instantiates it with
+ * constants. The compiler then turns the set and tag decode into
+ * constant shifts and masks and fully unrolls the way scan. The kernels
+ * keep the same state as the lru policy in policy.c (one timestamp per
+ * way) and the same counters as access_cache(), so a cache can move
+ * between them and the generic path at any point.
+ */
+#include <string.h>
+#include "kernel.h"
+
+/* The cache arrays and counters, kept in registers for a whole batch */
+typedef struct {
+    uint64_t *tags;
+    uint8_t *valid;
+    uint8_t *dirty;
+    uint64_t *stamps;
+    uint64_t timer;
+    long hits;
+    long misses;
+    long evictions;
+    long writebacks;
+} State;
+
+/* One load or store, as access_cache() under lru with write-back, write-allocate */
+static inline __attribute__((always_inline))
+void kernel_access(State *st, uint64_t set, uint64_t tag, bool write, const int E) {
+    size_t base = set * E;
+    uint64_t *tags = st->tags + base;
+    uint8_t *valid = st->valid + base;
+    uint8_t *dirty = st->dirty + base;
+    uint64_t *stamps = st->stamps + base;
+    int empty = -1;
+
+    st->timer++;
+    for (int i = 0; i < E; i++) {
+        if (valid[i] && tags[i] == tag) {
+            st->hits++;
+            dirty[i] |= write;
+            stamps[i] = st->timer;
+            return;
+        }
+        if (!valid[i] && empty < 0) {
+            empty = i;
+        }
+    }
+
+    st->misses++;
+    int way = empty;
+    if (way < 0) {
+        //Oldest stamp, lowest way on a tie as in lru_victim()
+        way = 0;
+        for (int i = 1; i < E; i++) {
+            if (stamps[i] < stamps[way]) {
+                way = i;
+            }
+        }
+        st->evictions++;
+        st->writebacks += dirty[way];
+    }
+    tags[way] = tag;
+    valid[way] = 1;
+    dirty[way] = write;
+    stamps[way] = st->timer;
+}
+
+static inline __attribute__((always_inline))
+void run_kernel(Cache *cache, const char *ops, const uint64_t *addrs, size_t n,
+                const int s, const int E, const int b) {
+    State st = {cache->tags, cache->valid, cache->dirty, cache->way_state,
+                cache->timer, cache->hits, cache->misses, cache->evictions,
+                cache->writebacks};
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t set = (addrs[i] >> b) & (((uint64_t)1 << s) - 1);
+        uint64_t tag = addrs[i] >> (b + s);
+        char op = ops[i];
+        //A Modify is a Load then a Store
+        if (op == 'L' || op == 'M') {
+            kernel_access(&st, set, tag, false, E);
+        }
+        if (op == 'S' || op == 'M') {
+            kernel_access(&st, set, tag, true, E);
+        }
+    }
+
+    //Every miss fills under write-allocate
+    cache->fills += st.misses - cache->misses;
+    cache->timer = st.timer;
+    cache->hits = st.hits;
+    cache->misses = st.misses;
+    cache->evictions = st.evictions;
+    cache->writebacks = st.writebacks;
+}
+
+#define KERNEL(s, E, b)                                                     \
+    static void kernel_##s##_##E##_##b(Cache *cache, const char *ops,       \
+                                       const uint64_t *addrs, size_t n) {   \
+        run_kernel(cache, ops, addrs, n, s, E, b);                          \
+    }
+
+//test-trans
+KERNEL(5, 1, 5)
+//test-csim
+KERNEL(1, 1, 1)
+KERNEL(4, 2, 4)
+KERNEL(2, 1, 4)
+KERNEL(2, 1, 3)
+KERNEL(2, 2, 3)
+KERNEL(2, 4, 3)
+
+static const struct {
+    int s, E, b;
+    Kernel run;
+} kernels[] = {
+    {5, 1, 5, kernel_5_1_5},
+    {1, 1, 1, kernel_1_1_1},
+    {4, 2, 4, kernel_4_2_4},
+    {2, 1, 4, kernel_2_1_4},
+    {2, 1, 3, kernel_2_1_3},
+    {2, 2, 3, kernel_2_2_3},
+    {2, 4, 3, kernel_2_4_3},
+};
+
+Kernel find_kernel(int s, int E, int b, const Policy *policy) {
+    //Only the timestamp lru, the recency list variant keeps other state
+    if (strcmp(policy->name, "lru") != 0 || policy->indexed) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (kernels[i].s == s && kernels[i].E == E && kernels[i].b == b) {
+            return kernels[i].run;
+        }
+    }
+    return NULL;
+}
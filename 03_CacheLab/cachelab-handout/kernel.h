@@ -0,0 +1,23 @@
+/*
+ * kernel.h - Simulators specialized at compile time for common geometries
+ */
+#ifndef CSIM_KERNEL_H
+#define CSIM_KERNEL_H
+
+#include "cache.h"
+
+/*
+ * The specialized kernel for a cache of this geometry and policy, or
+ * NULL if there is none. A kernel implements exact lru on its own and
+ * only stands in for simulate() on a plain cache (see kernel_ready()).
+ */
+Kernel find_kernel(int s, int E, int b, const Policy *policy);
+
+/* Whether cache->kernel may run: write-back, no splitting, nothing attached */
+static inline bool kernel_ready(const Cache *cache) {
+    return cache->kernel != NULL && cache->write_mode == 0 && !cache->split &&
+           cache->prefetcher == NULL && cache->classifier == NULL &&
+           cache->heatmap == NULL;
+}
+
+#endif /* CSIM_KERNEL_H */
@@ -0,0 +1,67 @@
+/*
+ * libcsim.c - The cache simulator as a library, a thin owner of a Cache
+ */
+#include <stdlib.h>
+#include "libcsim.h"
+#include "cache.h"
+
+struct CSim {
+    Cache cache;
+};
+
+CSim *csim_create(int s, int E, int b, const char *policy, int flags) {
+    const Policy *p = find_policy(policy != NULL ? policy : "lru");
+    if (p == NULL || s < 0 || b < 0 || E < 1 || s + b >= 64 ||
+        p->check(E) != NULL) {
+        return NULL;
+    }
+
+    CSim *sim = malloc(sizeof(*sim));
+    if (sim == NULL) {
+        return NULL;
+    }
+    Cache *cache = &sim->cache;
+    if (init_cache(cache, s, E, b, p) != 0) {
+        free(sim);
+        return NULL;
+    }
+    if (flags & CSIM_WRITE_THROUGH) {
+        cache->write_mode |= WRITE_THROUGH;
+    }
+    if (flags & CSIM_NO_WRITE_ALLOCATE) {
+        cache->write_mode |= WRITE_NO_ALLOCATE;
+    }
+    cache->split = (flags & CSIM_SPLIT) != 0;
+    return sim;
+}
+
+void csim_destroy(CSim *sim) {
+    if (sim != NULL) {
+        free_cache(&sim->cache);
+        free(sim);
+    }
+}
+
+void csim_access(CSim *sim, char op, uint64_t addr, int size) {
+    simulate(&sim->cache, op, addr, size);
+}
+
+void csim_access_batch(CSim *sim, const char *ops, const uint64_t *addrs,
+                       const int *sizes, size_t n) {
+    simulate_batch(&sim->cache, ops, addrs, sizes, n);
+}
+
+void csim_stats(const CSim *sim, CSimStats *stats) {
+    const Cache *cache = &sim->cache;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->writebacks = cache->writebacks;
+    stats->split_accesses = cache->split_accesses;
+    stats->read_bytes = read_traffic(cache);
+    stats->write_bytes = write_traffic(cache);
+}
+
+void csim_reset(CSim *sim) {
+    clear_cache(&sim->cache);
+}
@@ -0,0 +1,53 @@
+/*
+ * libcsim.h - The cache simulator as a library
+ *
+ * Each CSim is an independent simulated cache with its own state and
+ * counters; nothing is shared between them, so any number can be used
+ * at once, each from one thread at a time. Link with libcsim.a -lm.
+ */
+#ifndef LIBCSIM_H
+#define LIBCSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct CSim CSim;
+
+/* csim_create() flags, 0 is write-back, write-allocate, one block per access */
+#define CSIM_WRITE_THROUGH 1 //every store also goes to memory
+#define CSIM_NO_WRITE_ALLOCATE 2 //a store miss goes to memory without a fill
+#define CSIM_SPLIT 4 //an access spanning several blocks touches each of them
+
+/* Counters since creation or the last csim_reset() */
+typedef struct {
+    long hits;
+    long misses;
+    long evictions;
+    long writebacks; //dirty lines evicted
+    long split_accesses; //accesses that spanned more than one block
+    uint64_t read_bytes; //read from memory
+    uint64_t write_bytes; //written to memory
+} CSimStats;
+
+/*
+ * Create an empty cache of 2^s sets, E ways and 2^b byte blocks, evicting
+ * by the named policy (NULL for lru). Returns NULL if the geometry or
+ * policy is invalid or memory runs out.
+ */
+CSim *csim_create(int s, int E, int b, const char *policy, int flags);
+
+void csim_destroy(CSim *sim);
+
+/* Apply one access, op is 'L', 'S' or 'M' as in a trace */
+void csim_access(CSim *sim, char op, uint64_t addr, int size);
+
+/* Apply n accesses in order. sizes may be NULL for 1-byte accesses */
+void csim_access_batch(CSim *sim, const char *ops, const uint64_t *addrs,
+                       const int *sizes, size_t n);
+
+void csim_stats(const CSim *sim, CSimStats *stats);
+
+/* Empty the cache and zero its counters */
+void csim_reset(CSim *sim);
+
+#endif /* LIBCSIM_H */
@@ -0,0 +1,405 @@
+/*
+ * policy.c - Replacement policies for the simulated cache
+ *
+ * Every policy keeps its state in the words the cache arena reserves
+ * for it (see Policy in cache.h) and picks a victim in O(1) or O(log E),
+ * except lru which keeps the exact timestamp scan csim always used for
+ * sets of up to LRU_LIST_MIN_WAYS ways and switches to a recency list
+ * above that.
+ * Policies that need randomness keep a generator per set, so results
+ * do not depend on how sets are split across threads.
+ */
+#include <stddef.h>
+#include <string.h>
+#include "cache.h"
+
+static uint64_t full_mask(int E) {
+    return E == 64 ? ~(uint64_t)0 : ((uint64_t)1 << E) - 1;
+}
+
+static const char *check_any(int E) {
+    (void)E;
+    return NULL;
+}
+
+static const char *check_mask(int E) {
+    return E <= 64 ? NULL : "needs E <= 64";
+}
+
+static const char *check_tree(int E) {
+    if (E > 64 || (E & (E - 1)) != 0) {
+        return "needs E to be a power of two <= 64";
+    }
+    return NULL;
+}
+
+/* xorshift64 on a per-set word, seeded from the set index on first use */
+static uint64_t next_random(uint64_t *state, uint64_t set) {
+    uint64_t x = *state;
+    if (x == 0) {
+        x = 0x9e3779b97f4a7c15ULL ^ (set * 0xbf58476d1ce4e5b9ULL);
+        x += (x == 0);
+    }
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/*
+ * lru - Least recently used, by timestamp. One word per way holds the
+ * time of the last access.
+ */
+static void lru_touch(Cache *cache, uint64_t set, int way) {
+    *way_state(cache, set, way) = cache->timer;
+}
+
+static int lru_victim(Cache *cache, uint64_t set) {
+    uint64_t *stamps = way_state(cache, set, 0);
+    int lruIdx = 0;
+    for (int i = 1; i < cache->E; i++) {
+        if (stamps[i] < stamps[lruIdx]) {
+            lruIdx = i;
+        }
+    }
+    return lruIdx;
+}
+
+static const Policy lru_policy = {
+    "lru", "least recently used (exact)", 1, 0, 0,
+    check_any, lru_touch, lru_touch, lru_victim
+};
+
+/*
+ * lru with a recency list - The same replacement as lru, for sets too
+ * wide to scan. Each way holds prev/next links of a doubly-linked list
+ * from most (head) to least (tail) recently used, and the set holds
+ * head and tail. Invalid ways sit at the tail end, so the tail is always
+ * the way to fill next. Combined with the cache's tag index this makes
+ * every access O(1).
+ */
+#define LRU_LIST_MIN_WAYS 16
+
+enum { LIST_PREV, LIST_NEXT };
+enum { LIST_HEAD, LIST_TAIL };
+#define LIST_NONE UINT64_MAX
+
+static void lru_list_init(Cache *cache) {
+    for (uint64_t set = 0; set < cache->S; set++) {
+        //Way 0 at the tail so empty ways fill in order
+        for (int way = 0; way < cache->E; way++) {
+            uint64_t *ws = way_state(cache, set, way);
+            ws[LIST_PREV] = way + 1 < cache->E ? (uint64_t)way + 1 : LIST_NONE;
+            ws[LIST_NEXT] = way > 0 ? (uint64_t)way - 1 : LIST_NONE;
+        }
+        set_state(cache, set)[LIST_HEAD] = cache->E - 1;
+        set_state(cache, set)[LIST_TAIL] = 0;
+    }
+}
+
+static void lru_list_touch(Cache *cache, uint64_t set, int way) {
+    uint64_t *ends = set_state(cache, set);
+    uint64_t *ws = way_state(cache, set, way);
+    if (ends[LIST_HEAD] == (uint64_t)way) {
+        return;
+    }
+
+    //Unlink, way is not the head so it has a prev
+    way_state(cache, set, (int)ws[LIST_PREV])[LIST_NEXT] = ws[LIST_NEXT];
+    if (ws[LIST_NEXT] != LIST_NONE) {
+        way_state(cache, set, (int)ws[LIST_NEXT])[LIST_PREV] = ws[LIST_PREV];
+    }
+    else {
+        ends[LIST_TAIL] = ws[LIST_PREV];
+    }
+
+    //Push on the head
+    ws[LIST_PREV] = LIST_NONE;
+    ws[LIST_NEXT] = ends[LIST_HEAD];
+    way_state(cache, set, (int)ends[LIST_HEAD])[LIST_PREV] = way;
+    ends[LIST_HEAD] = way;
+}
+
+static int lru_list_victim(Cache *cache, uint64_t set) {
+    return (int)set_state(cache, set)[LIST_TAIL];
+}
+
+static void lru_list_invalidate(Cache *cache, uint64_t set, int way) {
+    uint64_t *ends = set_state(cache, set);
+    uint64_t *ws = way_state(cache, set, way);
+    if (ends[LIST_TAIL] == (uint64_t)way) {
+        return;
+    }
+
+    //Unlink, way is not the tail so it has a next
+    way_state(cache, set, (int)ws[LIST_NEXT])[LIST_PREV] = ws[LIST_PREV];
+    if (ws[LIST_PREV] != LIST_NONE) {
+        way_state(cache, set, (int)ws[LIST_PREV])[LIST_NEXT] = ws[LIST_NEXT];
+    }
+    else {
+        ends[LIST_HEAD] = ws[LIST_NEXT];
+    }
+
+    //Append on the tail, it is the next way to fill
+    ws[LIST_NEXT] = LIST_NONE;
+    ws[LIST_PREV] = ends[LIST_TAIL];
+    way_state(cache, set, (int)ends[LIST_TAIL])[LIST_NEXT] = way;
+    ends[LIST_TAIL] = way;
+}
+
+static const Policy lru_list_policy = {
+    "lru", "least recently used (recency list)", 2, 2, 0,
+    check_any, lru_list_touch, lru_list_touch, lru_list_victim,
+    lru_list_init, lru_list_invalidate, 1
+};
+
+/*
+ * fifo - First in first out, on the recency list of lru above with
+ * only fills moving a way to the head. A hole left by an invalidation
+ * (a lower level's back-invalidation, a coherence invalidation) drops to
+ * the tail, and whichever way is refilled becomes the newest, so the
+ * order survives holes being filled out of turn.
+ */
+static void nop_touch(Cache *cache, uint64_t set, int way) {
+    (void)cache; (void)set; (void)way;
+}
+
+static const Policy fifo_policy = {
+    "fifo", "first in first out", 2, 2, 0,
+    check_any, nop_touch, lru_list_touch, lru_list_victim,
+    lru_list_init, lru_list_invalidate
+};
+
+/* random - Uniformly random victim */
+static int random_victim(Cache *cache, uint64_t set) {
+    return (int)(next_random(set_state(cache, set), set) % cache->E);
+}
+
+static const Policy random_policy = {
+    "random", "random victim", 0, 1, 0,
+    check_any, nop_touch, nop_touch, random_victim
+};
+
+/*
+ * plru - Tree pseudo-LRU. The E-1 bits of a binary tree over the ways
+ * live in one set word, node n at bit n-1 with children 2n and 2n+1.
+ * A set bit means the victim is in the right subtree.
+ */
+static void plru_touch(Cache *cache, uint64_t set, int way) {
+    uint64_t *bits = set_state(cache, set);
+    int levels = __builtin_ctz(cache->E);
+    int node = 1;
+    for (int level = levels - 1; level >= 0; level--) {
+        int dir = (way >> level) & 1;
+        //Point this node away from the way just used
+        if (dir) {
+            *bits &= ~((uint64_t)1 << (node - 1));
+        }
+        else {
+            *bits |= (uint64_t)1 << (node - 1);
+        }
+        node = 2 * node + dir;
+    }
+}
+
+static int plru_victim(Cache *cache, uint64_t set) {
+    uint64_t bits = *set_state(cache, set);
+    int node = 1;
+    while (node < cache->E) {
+        node = 2 * node + (int)((bits >> (node - 1)) & 1);
+    }
+    return node - cache->E;
+}
+
+static const Policy plru_policy = {
+    "plru", "tree pseudo-LRU (E a power of two)", 0, 1, 0,
+    check_tree, plru_touch, plru_touch, plru_victim
+};
+
+/*
+ * bitplru - Bit pseudo-LRU (MRU bits). A way's bit is set on use, and
+ * once every bit is set all but the latest are cleared. The victim is
+ * the lowest way with a clear bit.
+ */
+static void bitplru_touch(Cache *cache, uint64_t set, int way) {
+    uint64_t *mru = set_state(cache, set);
+    *mru |= (uint64_t)1 << way;
+    if (*mru == full_mask(cache->E)) {
+        *mru = (uint64_t)1 << way;
+    }
+}
+
+static void bitplru_invalidate(Cache *cache, uint64_t set, int way) {
+    //An empty way is no longer recently used
+    *set_state(cache, set) &= ~((uint64_t)1 << way);
+}
+
+static int bitplru_victim(Cache *cache, uint64_t set) {
+    uint64_t free_ways = ~*set_state(cache, set) & full_mask(cache->E);
+    //With E = 1 the lone bit is never cleared
+    return free_ways != 0 ? __builtin_ctzll(free_ways) : 0;
+}
+
+static const Policy bitplru_policy = {
+    "bitplru", "bit pseudo-LRU (MRU bits)", 0, 1, 0,
+    check_mask, bitplru_touch, bitplru_touch, bitplru_victim,
+    NULL, bitplru_invalidate
+};
+
+/*
+ * srrip/brrip - Re-reference interval prediction with 2-bit RRPVs.
+ * Instead of a counter per way, each set keeps one way mask per RRPV
+ * value, so aging every way is a shift of four words and the victim is
+ * the lowest way in the RRPV=3 mask. Word 4 is the BRRIP generator.
+ */
+#define RRPV_MAX 3
+#define BRRIP_LONG_ODDS 32
+
+static void rrip_set(uint64_t *masks, int way, int rrpv) {
+    uint64_t bit = (uint64_t)1 << way;
+    for (int v = 0; v <= RRPV_MAX; v++) {
+        masks[v] &= ~bit;
+    }
+    masks[rrpv] |= bit;
+}
+
+static void rrip_hit(Cache *cache, uint64_t set, int way) {
+    rrip_set(set_state(cache, set), way, 0);
+}
+
+static void srrip_fill(Cache *cache, uint64_t set, int way) {
+    rrip_set(set_state(cache, set), way, RRPV_MAX - 1);
+}
+
+static void brrip_fill(Cache *cache, uint64_t set, int way) {
+    uint64_t *masks = set_state(cache, set);
+    //Mostly insert at distant, occasionally at long
+    int rrpv = next_random(&masks[4], set) % BRRIP_LONG_ODDS == 0 ?
+               RRPV_MAX - 1 : RRPV_MAX;
+    rrip_set(masks, way, rrpv);
+}
+
+static int rrip_victim(Cache *cache, uint64_t set) {
+    uint64_t *masks = set_state(cache, set);
+    while (masks[RRPV_MAX] == 0) {
+        //Age every way by one
+        for (int v = RRPV_MAX; v > 0; v--) {
+            masks[v] = masks[v - 1];
+        }
+        masks[0] = 0;
+    }
+    return __builtin_ctzll(masks[RRPV_MAX]);
+}
+
+static const Policy srrip_policy = {
+    "srrip", "static RRIP, 2-bit RRPV", 0, 5, 0,
+    check_mask, rrip_hit, srrip_fill, rrip_victim
+};
+
+static const Policy brrip_policy = {
+    "brrip", "bimodal RRIP, 2-bit RRPV", 0, 5, 0,
+    check_mask, rrip_hit, brrip_fill, rrip_victim
+};
+
+/*
+ * lfu - Least frequently used, ties broken by least recently used.
+ * Each set keeps a binary min-heap of its ways keyed on (count, stamp):
+ * set word 0 is the heap size and the next E words the heap. Way words
+ * are the count, the stamp and the heap position plus one (0 when the
+ * way is not in the heap).
+ */
+enum { LFU_COUNT, LFU_STAMP, LFU_POS, LFU_WORDS };
+
+static int lfu_less(Cache *cache, uint64_t set, uint64_t a, uint64_t b) {
+    uint64_t *wa = way_state(cache, set, (int)a);
+    uint64_t *wb = way_state(cache, set, (int)b);
+    if (wa[LFU_COUNT] != wb[LFU_COUNT]) {
+        return wa[LFU_COUNT] < wb[LFU_COUNT];
+    }
+    return wa[LFU_STAMP] < wb[LFU_STAMP];
+}
+
+static void lfu_place(Cache *cache, uint64_t set, uint64_t *heap,
+                      uint64_t pos, uint64_t way) {
+    heap[pos] = way;
+    way_state(cache, set, (int)way)[LFU_POS] = pos + 1;
+}
+
+static void lfu_sift(Cache *cache, uint64_t set, uint64_t pos) {
+    uint64_t *ss = set_state(cache, set);
+    uint64_t n = ss[0];
+    uint64_t *heap = ss + 1;
+    uint64_t way = heap[pos];
+
+    //Up
+    while (pos > 0 && lfu_less(cache, set, way, heap[(pos - 1) / 2])) {
+        lfu_place(cache, set, heap, pos, heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    //Down
+    for (;;) {
+        uint64_t child = 2 * pos + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && lfu_less(cache, set, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!lfu_less(cache, set, heap[child], way)) {
+            break;
+        }
+        lfu_place(cache, set, heap, pos, heap[child]);
+        pos = child;
+    }
+    lfu_place(cache, set, heap, pos, way);
+}
+
+static void lfu_hit(Cache *cache, uint64_t set, int way) {
+    uint64_t *ws = way_state(cache, set, way);
+    ws[LFU_COUNT]++;
+    ws[LFU_STAMP] = cache->timer;
+    lfu_sift(cache, set, ws[LFU_POS] - 1);
+}
+
+static void lfu_fill(Cache *cache, uint64_t set, int way) {
+    uint64_t *ws = way_state(cache, set, way);
+    ws[LFU_COUNT] = 1;
+    ws[LFU_STAMP] = cache->timer;
+    if (ws[LFU_POS] == 0) {
+        uint64_t *ss = set_state(cache, set);
+        lfu_place(cache, set, ss + 1, ss[0]++, way);
+    }
+    lfu_sift(cache, set, ws[LFU_POS] - 1);
+}
+
+static int lfu_victim(Cache *cache, uint64_t set) {
+    //Root of the heap
+    return (int)set_state(cache, set)[1];
+}
+
+static const Policy lfu_policy = {
+    "lfu", "least frequently used, LRU among ties", LFU_WORDS, 1, 1,
+    check_any, lfu_hit, lfu_fill, lfu_victim
+};
+
+const Policy *const policies[] = {
+    &lru_policy, &fifo_policy, &random_policy, &plru_policy,
+    &bitplru_policy, &srrip_policy, &brrip_policy, &lfu_policy, NULL
+};
+
+const Policy *specialize_policy(const Policy *policy, int E) {
+    //Scanning stamps stops paying off for wide sets
+    if (policy == &lru_policy && E > LRU_LIST_MIN_WAYS) {
+        return &lru_list_policy;
+    }
+    return policy;
+}
+
+const Policy *find_policy(const char *name) {
+    for (int i = 0; policies[i] != NULL; i++) {
+        if (strcmp(policies[i]->name, name) == 0) {
+            return policies[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,224 @@
+/*
+ * prefetch.c - Next-line, stride and stream prefetchers
+ *
+ * All three work on block numbers. Next-line and stream train on
+ * misses and on first hits to prefetched lines (otherwise a working
+ * prefetcher would stop seeing its own stream), the stride detector on
+ * every access, since it has no PC to key on it tracks address regions.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include "prefetch.h"
+
+#define DEFAULT_DEGREE 1
+#define DEFAULT_LATENCY 4
+
+static inline uint64_t hash_block(uint64_t block) {
+    block *= 0x9e3779b97f4a7c15ULL;
+    return block ^ (block >> 29);
+}
+
+int prefetch_init(Prefetcher *pf, const char *spec) {
+    char kind[8];
+    int degree = DEFAULT_DEGREE, latency = DEFAULT_LATENCY;
+
+    memset(pf, 0, sizeof(*pf));
+    if (sscanf(spec, "%7[^:]:%d:%d", kind, &degree, &latency) < 1) {
+        return -1;
+    }
+    if (strcmp(kind, "next") == 0) {
+        pf->kind = PF_NEXT_LINE;
+    }
+    else if (strcmp(kind, "stride") == 0) {
+        pf->kind = PF_STRIDE;
+    }
+    else if (strcmp(kind, "stream") == 0) {
+        pf->kind = PF_STREAM;
+    }
+    else {
+        return -1;
+    }
+    if (degree < 1 || degree > PF_QUEUE || latency < 0) {
+        return -1;
+    }
+    pf->degree = degree;
+    pf->latency = latency;
+    return 0;
+}
+
+/* A prefetch lands in the cache */
+static void fill(Prefetcher *pf, Cache *cache, uint64_t block) {
+    Evicted ev;
+    prefetch_block(cache, block << cache->b, &ev);
+    //Remember demand data it pushed out
+    if (ev.valid && !ev.prefetched) {
+        uint64_t victim = ev.addr >> cache->b;
+        pf->polluted[hash_block(victim) & (PF_FILTER - 1)] = victim + 1;
+    }
+}
+
+/* Position of block in the queue, or -1 */
+static int queued(Prefetcher *pf, uint64_t block) {
+    for (int i = 0; i < pf->count; i++) {
+        int slot = (pf->head + i) % PF_QUEUE;
+        if (pf->queue[slot] == block) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void issue(Prefetcher *pf, Cache *cache, uint64_t block) {
+    if (contains_block(cache, block << cache->b) || queued(pf, block) >= 0) {
+        return;
+    }
+    //A full queue drops it before it is issued
+    if (pf->latency > 0 && pf->count == PF_QUEUE) {
+        pf->dropped++;
+        return;
+    }
+    pf->issued++;
+    if (pf->latency == 0) {
+        fill(pf, cache, block);
+        return;
+    }
+    int slot = (pf->head + pf->count++) % PF_QUEUE;
+    pf->queue[slot] = block;
+    pf->ready[slot] = pf->clock + pf->latency;
+}
+
+void prefetch_before(Prefetcher *pf, Cache *cache, uint64_t addr) {
+    uint64_t block = addr >> cache->b;
+    pf->clock++;
+
+    //Everything due has landed, the latency is the same for all
+    while (pf->count > 0 && pf->ready[pf->head] <= pf->clock) {
+        fill(pf, cache, pf->queue[pf->head]);
+        pf->head = (pf->head + 1) % PF_QUEUE;
+        pf->count--;
+    }
+
+    //Still in flight, the demand miss fetches it instead
+    int pos = queued(pf, block);
+    if (pos >= 0) {
+        pf->late++;
+        for (int i = pos; i + 1 < pf->count; i++) {
+            pf->queue[(pf->head + i) % PF_QUEUE] = pf->queue[(pf->head + i + 1) % PF_QUEUE];
+            pf->ready[(pf->head + i) % PF_QUEUE] = pf->ready[(pf->head + i + 1) % PF_QUEUE];
+        }
+        pf->count--;
+    }
+}
+
+static void train_stride(Prefetcher *pf, Cache *cache, uint64_t block, uint64_t addr) {
+    uint64_t region = addr >> PF_REGION_BITS;
+    StrideEntry *e = &pf->strides[hash_block(region) & (PF_STRIDE_ENTRIES - 1)];
+
+    if (!e->valid || e->region != region) {
+        e->valid = true;
+        e->region = region;
+        e->last = block;
+        e->stride = 0;
+        e->confidence = 0;
+        return;
+    }
+
+    int64_t delta = (int64_t)(block - e->last);
+    if (delta == 0) {
+        return;
+    }
+    if (delta == e->stride) {
+        if (e->confidence < 3) {
+            e->confidence++;
+        }
+    }
+    else {
+        e->stride = delta;
+        e->confidence = 0;
+    }
+    e->last = block;
+
+    //The same stride twice in a row
+    if (e->confidence >= 1) {
+        for (int k = 1; k <= pf->degree; k++) {
+            issue(pf, cache, block + k * e->stride);
+        }
+    }
+}
+
+static void train_stream(Prefetcher *pf, Cache *cache, uint64_t block) {
+    Stream *st = NULL;
+    Stream *oldest = &pf->streams[0];
+
+    for (int i = 0; i < PF_STREAMS; i++) {
+        Stream *t = &pf->streams[i];
+        if (t->valid && t->last != block &&
+            block + PF_STREAM_WINDOW >= t->last && block <= t->last + PF_STREAM_WINDOW) {
+            st = t;
+            break;
+        }
+        if (!t->valid || (oldest->valid && t->used < oldest->used)) {
+            oldest = t;
+        }
+    }
+
+    if (st == NULL) {
+        //Start a new stream in place of the least recently used
+        oldest->valid = true;
+        oldest->last = block;
+        oldest->dir = 0;
+        oldest->confidence = 0;
+        oldest->used = pf->clock;
+        return;
+    }
+
+    int dir = block > st->last ? 1 : -1;
+    if (dir == st->dir) {
+        st->confidence++;
+    }
+    else {
+        st->dir = dir;
+        st->confidence = 1;
+    }
+    st->last = block;
+    st->used = pf->clock;
+
+    if (st->confidence >= 2) {
+        for (int k = 1; k <= pf->degree; k++) {
+            issue(pf, cache, block + k * st->dir);
+        }
+    }
+}
+
+void prefetch_after(Prefetcher *pf, Cache *cache, uint64_t addr, int result,
+                    bool used_prefetch) {
+    uint64_t block = addr >> cache->b;
+    bool miss = result != CACHE_HIT;
+
+    if (miss) {
+        uint64_t *slot = &pf->polluted[hash_block(block) & (PF_FILTER - 1)];
+        if (*slot == block + 1) {
+            pf->polluting++;
+            *slot = 0;
+        }
+    }
+
+    switch (pf->kind) {
+        case PF_NEXT_LINE:
+            if (miss || used_prefetch) {
+                for (int k = 1; k <= pf->degree; k++) {
+                    issue(pf, cache, block + k);
+                }
+            }
+            break;
+        case PF_STRIDE:
+            train_stride(pf, cache, block, addr);
+            break;
+        case PF_STREAM:
+            if (miss || used_prefetch) {
+                train_stream(pf, cache, block);
+            }
+            break;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * prefetch.h - Hardware prefetcher models for the simulated cache
+ *
+ * A prefetcher watches the demand accesses of one cache and queues
+ * block fills that land latency demand accesses later. Prefetched lines
+ * carry a bit in the cache, so their first demand hit counts as useful
+ * and an eviction before any use as unused. A demand miss on a block
+ * still in the queue is late, and one on a block a prefetch evicted is
+ * pollution.
+ */
+#ifndef CSIM_PREFETCH_H
+#define CSIM_PREFETCH_H
+
+#include "cache.h"
+
+#define PF_QUEUE 64             /* prefetches in flight */
+#define PF_STRIDE_ENTRIES 64    /* stride detector table */
+#define PF_REGION_BITS 12       /* the stride detector tracks 4KB regions */
+#define PF_STREAMS 16           /* sequential streams tracked */
+#define PF_STREAM_WINDOW 4      /* blocks a miss may be from a stream's last */
+#define PF_FILTER 4096          /* blocks remembered as pushed out by prefetches */
+
+typedef enum {
+    PF_NEXT_LINE,   /* the blocks after every miss */
+    PF_STRIDE,      /* a constant block stride within an address region */
+    PF_STREAM       /* ascending or descending runs of misses */
+} PrefetchKind;
+
+typedef struct {
+    bool valid;
+    uint64_t region;
+    uint64_t last;          /* last block touched in the region */
+    int64_t stride;
+    int confidence;         /* times in a row the stride repeated */
+} StrideEntry;
+
+typedef struct {
+    bool valid;
+    uint64_t last;          /* last block of the run */
+    int dir;                /* +1 or -1, 0 until a second miss */
+    int confidence;
+    uint64_t used;          /* clock of last use, for replacement */
+} Stream;
+
+struct Prefetcher {
+    PrefetchKind kind;
+    int degree;             /* blocks issued per trigger */
+    int latency;            /* demand accesses until a prefetch lands */
+    uint64_t clock;         /* demand accesses seen */
+    uint64_t queue[PF_QUEUE];
+    uint64_t ready[PF_QUEUE];
+    int head;
+    int count;
+    StrideEntry strides[PF_STRIDE_ENTRIES];
+    Stream streams[PF_STREAMS];
+    uint64_t polluted[PF_FILTER];   /* block + 1, 0 if empty */
+    long issued;
+    long late;
+    long polluting;
+    long dropped;           /* queue was full */
+};
+
+/*
+ * Set up a prefetcher from "kind[:degree[:latency]]", kind being next,
+ * stride or stream. Returns 0, or -1 if the spec is malformed.
+ */
+int prefetch_init(Prefetcher *pf, const char *spec);
+
+/* Called around every demand access of cache (see simulate()) */
+void prefetch_before(Prefetcher *pf, Cache *cache, uint64_t addr);
+void prefetch_after(Prefetcher *pf, Cache *cache, uint64_t addr, int result,
+                    bool used_prefetch);
+
+#endif /* CSIM_PREFETCH_H */
@@ -0,0 +1,17 @@
+/*
+ * region.c - The marked region a transpose function is traced in
+ *
+ * trans, M and N come in as arguments, so inside the region the only
+ * accesses outside the stack are the two marker stores and the
+ * function's own to A and B.
+ */
+#include "region.h"
+
+Region region __attribute__((aligned(4096)));
+
+void run_region(void (*trans)(int M, int N, int[N][M], int[M][N]), int M, int N)
+{
+    STORE(region.marker_start, 33);
+    (*trans)(M, N, region.A, region.B);
+    STORE(region.marker_end, 34);
+}
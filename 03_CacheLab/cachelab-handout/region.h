@@ -0,0 +1,31 @@
+/*
+ * region.h - The marked region a transpose function is traced in
+ *
+ * tracegen runs a function between two marker stores under valgrind,
+ * and csim cuts the trace at the markers. test-trans links region.c
+ * built again with TRACE_TRANS, like trans.c, and runs the same code
+ * in-process. Both programs see the same accesses, at the same offsets
+ * in the page-aligned region, so both give the same counts for any
+ * block size up to a page.
+ */
+#ifndef CACHELAB_REGION_H
+#define CACHELAB_REGION_H
+
+#include "cachelab.h"
+
+/* Maximum array dimension */
+#define REGION_MAXN 256
+
+typedef struct {
+    volatile char marker_start;
+    volatile char marker_end;
+    int A[REGION_MAXN][REGION_MAXN] __attribute__((aligned(32)));
+    int B[REGION_MAXN][REGION_MAXN];
+} Region;
+
+extern Region region;
+
+/* Transpose region.A into region.B with trans, between the markers */
+void run_region(void (*trans)(int M, int N, int[N][M], int[M][N]), int M, int N);
+
+#endif /* CACHELAB_REGION_H */
@@ -0,0 +1,233 @@
+/*
+ * sample.c - Set and time sampled simulation of one cache
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sample.h"
+
+//Two-sided 95% normal quantile
+#define Z95 1.96
+
+const char *sample_init(Sampler *sp, const char *spec) {
+    memset(sp, 0, sizeof(*sp));
+    sp->warm = SAMPLE_WARM_ALL;
+    if (strncmp(spec, "sets:", 5) == 0) {
+        char *end;
+        sp->kind = SAMPLE_SETS;
+        sp->ratio = strtol(spec + 5, &end, 10);
+        if (end == spec + 5 || *end != '\0' || sp->ratio < 1) {
+            return "sets:ratio takes a positive ratio";
+        }
+        return NULL;
+    }
+    if (strncmp(spec, "time:", 5) == 0) {
+        long v[3];
+        int n = 0;
+        const char *p = spec + 4;
+        while (*p == ':' && n < 3) {
+            char *end;
+            v[n] = strtol(p + 1, &end, 10);
+            if (end == p + 1) {
+                break;
+            }
+            n++;
+            p = end;
+        }
+        if (*p != '\0' || n < 2) {
+            return "time takes period:window[:warm]";
+        }
+        sp->kind = SAMPLE_TIME;
+        sp->period = v[0];
+        sp->window = v[1];
+        if (n == 3) {
+            sp->warm = v[2];
+        }
+        if (sp->window < 1 || sp->period < sp->window ||
+            (n == 3 && (sp->warm < 0 || sp->warm > sp->period - sp->window))) {
+            return "need 1 <= window <= period and window + warm <= period";
+        }
+        return NULL;
+    }
+    return "sets:ratio or time:period:window[:warm]";
+}
+
+/* Make room for one more unit. Returns 0 on success, -1 on error */
+static int grow_units(Sampler *sp) {
+    if (sp->nunits < sp->units_cap) {
+        return 0;
+    }
+    long cap = sp->units_cap ? sp->units_cap * 2 : 1024;
+    long *a = realloc(sp->accesses, cap * sizeof(long));
+    if (a != NULL) {
+        sp->accesses = a;
+    }
+    long *m = realloc(sp->misses, cap * sizeof(long));
+    if (m != NULL) {
+        sp->misses = m;
+    }
+    long *e = realloc(sp->evictions, cap * sizeof(long));
+    if (e != NULL) {
+        sp->evictions = e;
+    }
+    if (a == NULL || m == NULL || e == NULL) {
+        return -1;
+    }
+    sp->units_cap = cap;
+    return 0;
+}
+
+/* Whether a set is in the sample, a fixed pseudo-random 1 in ratio */
+static inline bool sampled_set(const Sampler *sp, uint64_t set) {
+    set *= 0x9e3779b97f4a7c15ULL;
+    return (set ^ (set >> 29)) % sp->ratio == 0;
+}
+
+/* Accesses (lookups) a record makes, a Modify is a Load then a Store */
+static inline long lookups(char op) {
+    return op == 'M' ? 2 : 1;
+}
+
+static const char *run_sets(Sampler *sp, Cache *cache, Trace *trace) {
+    TraceRecord rec;
+    uint64_t set_mask = cache->S - 1;
+
+    //One unit per set for now, packed down to the sampled ones at the end
+    sp->accesses = calloc(cache->S, sizeof(long));
+    sp->misses = calloc(cache->S, sizeof(long));
+    sp->evictions = calloc(cache->S, sizeof(long));
+    if (sp->accesses == NULL || sp->misses == NULL || sp->evictions == NULL) {
+        return "out of memory";
+    }
+    sp->units_cap = cache->S;
+
+    while (trace_next(trace, &rec)) {
+        sp->total += lookups(rec.op);
+        uint64_t set = (rec.addr >> cache->b) & set_mask;
+        if (!sampled_set(sp, set)) {
+            continue;
+        }
+        long accesses = cache->hits + cache->misses;
+        long misses = cache->misses;
+        long evictions = cache->evictions;
+        simulate(cache, rec.op, rec.addr, rec.size);
+        sp->accesses[set] += cache->hits + cache->misses - accesses;
+        sp->misses[set] += cache->misses - misses;
+        sp->evictions[set] += cache->evictions - evictions;
+    }
+
+    for (uint64_t set = 0; set < cache->S; set++) {
+        if (sampled_set(sp, set)) {
+            sp->accesses[sp->nunits] = sp->accesses[set];
+            sp->misses[sp->nunits] = sp->misses[set];
+            sp->evictions[sp->nunits] = sp->evictions[set];
+            sp->simulated += sp->accesses[set];
+            sp->nunits++;
+        }
+    }
+    sp->population = cache->S;
+    if (sp->nunits == 0) {
+        return "samples none of the sets, lower the ratio";
+    }
+    return NULL;
+}
+
+static const char *run_time(Sampler *sp, Cache *cache, Trace *trace) {
+    TraceRecord rec;
+    long first = sp->period - sp->window;
+    long skip = sp->warm == SAMPLE_WARM_ALL ? 0 : first - sp->warm;
+    long phase = 0, records = 0;
+    long accesses = 0, misses = 0, evictions = 0;
+
+    while (trace_next(trace, &rec)) {
+        sp->total += lookups(rec.op);
+        records++;
+        if (phase >= skip) {
+            if (phase == first) {
+                //The window starts, count from here
+                accesses = cache->hits + cache->misses;
+                misses = cache->misses;
+                evictions = cache->evictions;
+            }
+            simulate(cache, rec.op, rec.addr, rec.size);
+            if (phase == sp->period - 1) {
+                if (grow_units(sp) != 0) {
+                    return "out of memory";
+                }
+                long n = sp->nunits++;
+                sp->accesses[n] = cache->hits + cache->misses - accesses;
+                sp->misses[n] = cache->misses - misses;
+                sp->evictions[n] = cache->evictions - evictions;
+                sp->simulated += sp->accesses[n];
+            }
+        }
+        if (++phase == sp->period) {
+            phase = 0;
+        }
+    }
+
+    //The trace is cut into window-sized units, one in period/window is measured
+    sp->population = records / sp->window;
+    if (sp->nunits == 0) {
+        return "is shorter than one period";
+    }
+    return NULL;
+}
+
+const char *sample_run(Sampler *sp, Cache *cache, Trace *trace) {
+    return sp->kind == SAMPLE_SETS ? run_sets(sp, cache, trace)
+                                   : run_time(sp, cache, trace);
+}
+
+void sample_print(const Sampler *sp) {
+    double a = 0, m = 0, e = 0;
+    for (long i = 0; i < sp->nunits; i++) {
+        a += sp->accesses[i];
+        m += sp->misses[i];
+        e += sp->evictions[i];
+    }
+    double ratio = a > 0 ? m / a : 0;
+    double eviction_ratio = a > 0 ? e / a : 0;
+
+    //Ratio estimator over n units out of N, with the finite population correction
+    double half = -1;
+    long n = sp->nunits;
+    if (n > 1 && a > 0) {
+        double ss = 0;
+        for (long i = 0; i < n; i++) {
+            double d = sp->misses[i] - ratio * sp->accesses[i];
+            ss += d * d;
+        }
+        double mean = a / n;
+        double fpc = sp->population > n ? 1.0 - (double)n / sp->population : 0.0;
+        half = Z95 * sqrt(fpc * ss / (n - 1) / n) / mean;
+    }
+
+    if (sp->kind == SAMPLE_SETS) {
+        printf("sample: %ld of %ld sets, ", n, sp->population);
+    }
+    else {
+        printf("sample: %ld of %ld windows, ", n, sp->population);
+    }
+    printf("%ld of %ld accesses counted\n", sp->simulated, sp->total);
+
+    long misses = (long)(ratio * sp->total + 0.5);
+    if (half >= 0) {
+        printf("miss-ratio:%.6f +-%.6f misses:%ld +-%ld (95%% confidence)\n",
+               ratio, half, misses, (long)(half * sp->total + 0.5));
+    }
+    else {
+        printf("miss-ratio:%.6f misses:%ld (too few units for an interval)\n",
+               ratio, misses);
+    }
+    printf("hits:%ld misses:%ld evictions:%ld (estimated)\n", sp->total - misses,
+           misses, (long)(eviction_ratio * sp->total + 0.5));
+}
+
+void sample_free(Sampler *sp) {
+    free(sp->accesses);
+    free(sp->misses);
+    free(sp->evictions);
+    sp->accesses = sp->misses = sp->evictions = NULL;
+}
@@ -0,0 +1,59 @@
+/*
+ * sample.h - Sampled simulation of one cache, with confidence intervals
+ *
+ * Set sampling only simulates the records that map to a fixed,
+ * pseudo-randomly chosen 1 in ratio of the sets. Sets never interact,
+ * so every sampled set behaves exactly as in a full run and each set is
+ * one sampling unit.
+ *
+ * Time sampling (SMARTS) measures a detailed window of records at the
+ * end of every period. With functional warming every record still
+ * updates the cache and only the windows are counted; with a bounded
+ * warm-up only the warm records before each window are simulated and
+ * the rest of the period is skipped. Each window is one unit.
+ *
+ * Either way the miss ratio is a ratio estimate over the units, and
+ * totals are that ratio times every access in the trace.
+ */
+#ifndef CSIM_SAMPLE_H
+#define CSIM_SAMPLE_H
+
+#include "cache.h"
+#include "trace.h"
+
+typedef enum { SAMPLE_SETS, SAMPLE_TIME } SampleKind;
+
+//Functional warming, simulate every record between windows
+#define SAMPLE_WARM_ALL -1
+
+typedef struct {
+    SampleKind kind;
+    long ratio;         /* sets: 1 in ratio sets */
+    long period;        /* time: records per period */
+    long window;        /* records measured at the end of each */
+    long warm;          /* records simulated before it, or SAMPLE_WARM_ALL */
+    long nunits;        /* sets sampled, or windows measured */
+    long units_cap;
+    long *accesses;     /* per unit */
+    long *misses;
+    long *evictions;
+    long population;    /* units the whole trace has */
+    long total;         /* accesses (lookups) in the whole trace */
+    long simulated;     /* of which counted in a unit */
+} Sampler;
+
+/*
+ * Parse "sets:ratio" or "time:period:window[:warm]". Returns NULL on
+ * success, otherwise an error message.
+ */
+const char *sample_init(Sampler *sp, const char *spec);
+
+/* Run the trace through cache under the sampler. Returns NULL or an error message */
+const char *sample_run(Sampler *sp, Cache *cache, Trace *trace);
+
+/* Estimated totals and miss ratio with its 95% confidence interval */
+void sample_print(const Sampler *sp);
+
+void sample_free(Sampler *sp);
+
+#endif /* CSIM_SAMPLE_H */
@@ -0,0 +1,261 @@
+/*
+ * stackdist.c - Single pass LRU stack distance (Mattson) engine
+ *
+ * Each set owns a treap of its distinct blocks ordered by last access
+ * time. On an access at time t to a block last seen at time p, its stack
+ * distance is the number of nodes keyed after p. The node is then erased
+ * and re-appended with key t, which is always the largest key in the
+ * tree, so a single merge puts it back.
+ *
+ * A block missing from the table misses at every E. When its set's
+ * tree already holds max_ways blocks, the least recent one is dropped
+ * to make room: it is at distance max_ways - 1 and only gets deeper,
+ * so it would miss at every E too on its next access.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "stackdist.h"
+
+#define NIL (-1)
+
+static inline int32_t size_of(const StackDist *sd, int32_t n) {
+    return n == NIL ? 0 : sd->nodes[n].size;
+}
+
+static inline void update(StackDist *sd, int32_t n) {
+    sd->nodes[n].size = 1 + size_of(sd, sd->nodes[n].left) +
+                        size_of(sd, sd->nodes[n].right);
+}
+
+/* Join two treaps where every key of l is below every key of r */
+static int32_t merge(StackDist *sd, int32_t l, int32_t r) {
+    if (l == NIL) {
+        return r;
+    }
+    if (r == NIL) {
+        return l;
+    }
+    if (sd->nodes[l].priority > sd->nodes[r].priority) {
+        sd->nodes[l].right = merge(sd, sd->nodes[l].right, r);
+        update(sd, l);
+        return l;
+    }
+    sd->nodes[r].left = merge(sd, l, sd->nodes[r].left);
+    update(sd, r);
+    return r;
+}
+
+/* Remove the node keyed time from t, returns the new root */
+static int32_t erase(StackDist *sd, int32_t t, uint64_t time) {
+    SDNode *n = &sd->nodes[t];
+    if (n->time == time) {
+        return merge(sd, n->left, n->right);
+    }
+    if (time < n->time) {
+        n->left = erase(sd, n->left, time);
+    }
+    else {
+        n->right = erase(sd, n->right, time);
+    }
+    n->size--;
+    return t;
+}
+
+/* Least recent node of the non-empty treap t */
+static int32_t oldest(const StackDist *sd, int32_t t) {
+    while (sd->nodes[t].left != NIL) {
+        t = sd->nodes[t].left;
+    }
+    return t;
+}
+
+/* Number of keys in t later than time */
+static uint64_t count_after(const StackDist *sd, int32_t t, uint64_t time) {
+    uint64_t count = 0;
+    while (t != NIL) {
+        const SDNode *n = &sd->nodes[t];
+        if (n->time > time) {
+            count += 1 + size_of(sd, n->right);
+            t = n->left;
+        }
+        else {
+            t = n->right;
+        }
+    }
+    return count;
+}
+
+static inline uint64_t hash_block(uint64_t block) {
+    block *= 0x9e3779b97f4a7c15ULL;
+    return block ^ (block >> 29);
+}
+
+/* Slot holding block, or the empty slot where it belongs */
+static uint64_t find_slot(const StackDist *sd, uint64_t block) {
+    uint64_t i = hash_block(block) & sd->table_mask;
+    while (sd->table[i] != NIL && sd->nodes[sd->table[i]].block != block) {
+        i = (i + 1) & sd->table_mask;
+    }
+    return i;
+}
+
+/* Empty slot i, shifting back the entries that probed past it */
+static void table_remove(StackDist *sd, uint64_t i) {
+    uint64_t j = i;
+    for (;;) {
+        j = (j + 1) & sd->table_mask;
+        if (sd->table[j] == NIL) {
+            break;
+        }
+        //The entry at j may move to i unless its home lies in (i, j]
+        uint64_t home = hash_block(sd->nodes[sd->table[j]].block) & sd->table_mask;
+        if (((j - home) & sd->table_mask) >= ((j - i) & sd->table_mask)) {
+            sd->table[i] = sd->table[j];
+            i = j;
+        }
+    }
+    sd->table[i] = NIL;
+}
+
+static int grow_table(StackDist *sd) {
+    uint64_t size = (sd->table_mask + 1) * 2;
+    int32_t *table = malloc(size * sizeof(int32_t));
+    if (table == NULL) {
+        return -1;
+    }
+    free(sd->table);
+    sd->table = table;
+    memset(sd->table, 0xff, size * sizeof(int32_t));
+    sd->table_mask = size - 1;
+    for (int64_t n = 0; n < sd->nnodes; n++) {
+        sd->table[find_slot(sd, sd->nodes[n].block)] = n;
+    }
+    return 0;
+}
+
+static uint32_t next_priority(StackDist *sd) {
+    //xorshift32
+    uint32_t x = sd->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return sd->seed = x;
+}
+
+int sd_init(StackDist *sd, int s, int b, int max_ways) {
+    memset(sd, 0, sizeof(*sd));
+    sd->s = s;
+    sd->b = b;
+    sd->max_ways = max_ways;
+    sd->S = (uint64_t)1 << s;
+    sd->seed = 2463534242u;
+    if (sd->S > (uint64_t)INT32_MAX / max_ways) {
+        return -1;
+    }
+    sd->max_nodes = sd->S * max_ways;
+
+    sd->roots = malloc(sd->S * sizeof(int32_t));
+    sd->hist = calloc(max_ways, sizeof(uint64_t));
+    sd->cap_nodes = sd->max_nodes < 1024 ? sd->max_nodes : 1024;
+    sd->nodes = malloc(sd->cap_nodes * sizeof(SDNode));
+    sd->table_mask = 2047;
+    sd->table = malloc((sd->table_mask + 1) * sizeof(int32_t));
+    if (!sd->roots || !sd->hist || !sd->nodes || !sd->table) {
+        sd_free(sd);
+        return -1;
+    }
+    memset(sd->roots, 0xff, sd->S * sizeof(int32_t));
+    memset(sd->table, 0xff, (sd->table_mask + 1) * sizeof(int32_t));
+    return 0;
+}
+
+void sd_access(StackDist *sd, uint64_t addr) {
+    uint64_t block = addr >> sd->b;
+    int32_t *root = &sd->roots[block & (sd->S - 1)];
+    uint64_t now = ++sd->time;
+    uint64_t slot = find_slot(sd, block);
+    int32_t n = sd->table[slot];
+
+    if (n != NIL) {
+        //The tree holds at most max_ways nodes, so the distance is below it
+        uint64_t last = sd->nodes[n].time;
+        sd->hist[count_after(sd, *root, last)]++;
+
+        //Cut the node out of the tree
+        *root = erase(sd, *root, last);
+    }
+    else {
+        sd->far++;
+        if (size_of(sd, *root) == sd->max_ways) {
+            //Drop the set's least recent block and reuse its node
+            n = oldest(sd, *root);
+            *root = erase(sd, *root, sd->nodes[n].time);
+            table_remove(sd, find_slot(sd, sd->nodes[n].block));
+            slot = find_slot(sd, block);
+        }
+        else {
+            //Take a fresh node
+            if (sd->nnodes == sd->cap_nodes) {
+                int64_t cap = 2 * sd->cap_nodes < sd->max_nodes ? 2 * sd->cap_nodes
+                                                                : sd->max_nodes;
+                SDNode *nodes = realloc(sd->nodes, cap * sizeof(SDNode));
+                if (nodes == NULL) {
+                    fprintf(stderr, "Error: Out of memory for the stack distance tree\n");
+                    exit(1);
+                }
+                sd->nodes = nodes;
+                sd->cap_nodes = cap;
+            }
+            n = sd->nnodes++;
+        }
+        sd->nodes[n].block = block;
+        sd->nodes[n].priority = next_priority(sd);
+        sd->table[slot] = n;
+        //Keep the table at most half full
+        if ((uint64_t)sd->nnodes * 2 > sd->table_mask + 1 && grow_table(sd) != 0) {
+            fprintf(stderr, "Error: Out of memory for the stack distance table\n");
+            exit(1);
+        }
+    }
+
+    //now is later than every key, so it goes on the right edge
+    SDNode *node = &sd->nodes[n];
+    node->time = now;
+    node->left = node->right = NIL;
+    node->size = 1;
+    *root = merge(sd, *root, n);
+}
+
+void sd_counts(const StackDist *sd, int E,
+               long *hits, long *misses, long *evictions) {
+    uint64_t h = 0;
+    for (int d = 0; d < E; d++) {
+        h += sd->hist[d];
+    }
+
+    //A set with k distinct blocks fills min(k, E) empty ways, every
+    //other miss evicts. Its tree holds min(k, max_ways) blocks, which
+    //gives the same min for any E up to max_ways
+    uint64_t fills = 0;
+    for (uint64_t i = 0; i < sd->S; i++) {
+        uint64_t k = size_of(sd, sd->roots[i]);
+        fills += k < (uint64_t)E ? k : (uint64_t)E;
+    }
+
+    *hits = h;
+    *misses = sd->time - h;
+    *evictions = *misses - fills;
+}
+
+void sd_free(StackDist *sd) {
+    free(sd->roots);
+    free(sd->hist);
+    free(sd->nodes);
+    free(sd->table);
+    sd->roots = NULL;
+    sd->hist = NULL;
+    sd->nodes = NULL;
+    sd->table = NULL;
+}
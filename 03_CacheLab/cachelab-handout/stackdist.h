@@ -0,0 +1,69 @@
+/*
+ * stackdist.h - Single pass LRU stack distance (Mattson) engine
+ *
+ * For a fixed number of sets and block size, an access hits in an LRU
+ * cache of associativity E exactly when fewer than E other blocks of its
+ * set were touched since its previous access (its stack distance is
+ * below E). Recording the distance of every access once gives the hit,
+ * miss and eviction counts of every E at the same time.
+ *
+ * Only distances below max_ways are reported, so a set never needs to
+ * remember more than its max_ways most recent blocks, which bounds the
+ * memory on traces of any length.
+ */
+#ifndef CSIM_STACKDIST_H
+#define CSIM_STACKDIST_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t time;      /* last access time, the tree key */
+    uint64_t block;     /* block address, the hash key */
+    uint32_t priority;  /* treap heap priority */
+    int32_t left;
+    int32_t right;
+    int32_t size;       /* nodes in this subtree */
+} SDNode;
+
+/*
+ * StackDist - One treap per set holds that set's max_ways most recent
+ * blocks keyed by last access time, so the stack distance of a block is
+ * the number of nodes with a later key, an O(log n) rank query. A hash
+ * table maps block addresses to their node.
+ */
+typedef struct {
+    int s;
+    int b;
+    int max_ways;           /* largest associativity reported */
+    uint64_t S;
+    int32_t *roots;         /* per-set treap root, -1 if empty */
+    SDNode *nodes;
+    int64_t nnodes;
+    int64_t cap_nodes;
+    int64_t max_nodes;      /* S * max_ways, a treap holds at most max_ways */
+    int32_t *table;         /* open addressed block -> node index */
+    uint64_t table_mask;
+    uint64_t time;
+    uint32_t seed;
+    uint64_t *hist;         /* hist[d] = accesses with stack distance d */
+    uint64_t far;           /* misses at every E: first touches, and */
+                            /* blocks no longer among the last max_ways */
+} StackDist;
+
+/*
+ * Set up an engine for 2^s sets of 2^b byte blocks. Returns 0 on
+ * success, -1 if out of memory or 2^s * max_ways nodes would not fit in
+ * the 32-bit node links.
+ */
+int sd_init(StackDist *sd, int s, int b, int max_ways);
+
+/* Record one access to addr */
+void sd_access(StackDist *sd, uint64_t addr);
+
+/* Counts an LRU cache with E ways (1 <= E <= max_ways) would report */
+void sd_counts(const StackDist *sd, int E,
+               long *hits, long *misses, long *evictions);
+
+void sd_free(StackDist *sd);
+
+#endif /* CSIM_STACKDIST_H */
@@ -12,11 +12,14 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "libcsim.h"
+#include "tracer.h"
+#include "region.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
 
 /* Maximum array dimension */
-#define MAXN 256
+#define MAXN REGION_MAXN
 
 /* The description string for the transpose_submit() function that the
    student submits for credit */
@@ -32,6 +35,11 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int use_valgrind = 0; /* trace under valgrind instead of in-process */
+static int check_valgrind = 0; /* trace both ways and compare the counts */
+
+/* Functions whose in-process and valgrind counts differ */
+static int mismatches = 0;
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -41,23 +49,143 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/*
+ * validate - Compare B against the reference transpose of A
+ */
+static int validate(int fn, int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+    int (*C)[N] = calloc(M, sizeof(*C));
+    assert(C);
+    correctTrans(M, N, A, C);
+    for (i = 0; i < M; i++) {
+        for (j = 0; j < N; j++) {
+            if (B[i][j] != C[i][j]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",
+                       fn, C[i][j], B[i][j], i, j);
+                free(C);
+                return 0;
+            }
+        }
+    }
+    free(C);
+    return 1;
+}
+
+/*
+ * trace_native - Run function i in this process, through the same
+ * region code as tracegen. Its accesses reach the simulated cache
+ * through the LOAD() and STORE() hooks in tracer.c. Returns 0 if the
+ * result is correct, otherwise i+1 as tracegen would.
+ */
+static int trace_native(int i, unsigned int s, unsigned int E, unsigned int b,
+                        unsigned int *hits, unsigned int *misses,
+                        unsigned int *evictions)
+{
+    CSimStats stats;
+    CSim *sim = csim_create(s, E, b, NULL, 0);
+
+    if (sim == NULL) {
+        fprintf(stderr, "Error: Could not create the simulated cache\n");
+        exit(1);
+    }
+    initMatrix(M, N, region.A, region.B);
+
+    tracer_start(sim, &region, &region + 1);
+    run_region(func_list[i].func_ptr, M, N);
+    tracer_stop();
+
+    csim_stats(sim, &stats);
+    *hits = stats.hits;
+    *misses = stats.misses;
+    *evictions = stats.evictions;
+    csim_destroy(sim);
+    return validate(i, M, N, region.A, region.B) ? 0 : i+1;
+}
+
+/*
+ * trace_valgrind - Run function i under valgrind and stream its trace
+ * through csim. Returns tracegen's exit status.
+ */
+static int trace_valgrind(int i, unsigned int s, unsigned int E, unsigned int b,
+                          unsigned int *hits, unsigned int *misses,
+                          unsigned int *evictions)
+{
+    int flag;
+    char cmd[512];
+
+    /* Stale files from the previous function must not be picked up */
+    unlink(".marker");
+    unlink(".csim_results");
+    unlink(".tracegen_status");
+
+    /* 
+     * Stream the valgrind trace straight into the simulator, a
+     * single pass with no trace files on disk. csim cuts out the
+     * region between the markers (read from the .marker file that
+     * tracegen writes before touching them) and ignores the high
+     * (Valgrind stack) half of the address space. The exit status
+     * of tracegen comes back through a file, since the pipeline's
+     * own status is csim's.
+     */
+    sprintf(cmd, "{ valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d; "
+            "echo $? > .tracegen_status; } | "
+            "./csim -m @.marker -l -s %u -E %u -b %u -t - > /dev/null",
+            M, N, i, s, E, b);
+    system(cmd);
+
+    FILE* status_fp = fopen(".tracegen_status", "r");
+    assert(status_fp);
+    if (fscanf(status_fp, "%d", &flag) != 1)
+        flag = -1;
+    fclose(status_fp);
+    if (0!=flag)
+        return flag;
+
+    /* Collect results from the simulator */
+    FILE* in_fp = fopen(".csim_results","r");
+    assert(in_fp);
+    fscanf(in_fp, "%u %u %u", hits, misses, evictions);
+    fclose(in_fp);
+    return 0;
+}
+
+/*
+ * check_valgrind_counts - Trace function i under valgrind as well and
+ * report whether its counts differ from the in-process ones. Returns
+ * tracegen's exit status.
+ */
+static int check_valgrind_counts(int i, unsigned int s, unsigned int E, unsigned int b,
+                                 unsigned int hits, unsigned int misses,
+                                 unsigned int evictions)
+{
+    unsigned int vhits, vmisses, vevictions;
+    int flag = trace_valgrind(i, s, E, b, &vhits, &vmisses, &vevictions);
+
+    if (0!=flag)
+        return flag;
+    if (hits != vhits || misses != vmisses || evictions != vevictions) {
+        printf("Error: func %d counts differ, in-process hits:%u, misses:%u, evictions:%u, "
+               "valgrind hits:%u, misses:%u, evictions:%u\n",
+               i, hits, misses, evictions, vhits, vmisses, vevictions);
+        mismatches++;
+    }
+    else {
+        printf("func %d: in-process and valgrind counts agree\n", i);
+    }
+    return 0;
+}
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
     int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    unsigned int hits, misses, evictions;
 
     registerFunctions(); 
 
-    /* Open the complete trace file */
-    FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
-
     /* Evaluate the performance of each registered transpose function */
 
     for (i=0; i<func_counter; i++) {
@@ -65,23 +193,20 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.funcid = i; /* remember which function is the submission */
 
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+        printf("\nFunction %d (%d total)\nStep 1: Validating and simulating memory traces (s=%d, E=%d, b=%d)\n",
+               i, func_counter, s, E, b);
 
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
+        if (use_valgrind && !check_valgrind)
+            flag = trace_valgrind(i, s, E, b, &hits, &misses, &evictions);
+        else
+            flag = trace_native(i, s, E, b, &hits, &misses, &evictions);
+        if (0==flag && check_valgrind)
+            flag = check_valgrind_counts(i, s, E, b, hits, misses, evictions);
         if (0!=flag) {
             printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
             continue;
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
-
         func_list[i].correct=1;
 
         /* Save the correctness of the transpose submission */
@@ -89,63 +214,6 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
         func_list[i].num_hits = hits;
         func_list[i].num_misses = misses;
         func_list[i].num_evictions = evictions;
@@ -164,11 +232,13 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hVC] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+    printf("  -V          Trace under valgrind and csim instead of in-process\n");
+    printf("  -C          Trace both ways and check that the counts agree\n");
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
 }
 
@@ -199,7 +269,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:hVC")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +277,12 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'V':
+            use_valgrind = 1;
+            break;
+        case 'C':
+            check_valgrind = 1;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -257,5 +333,10 @@ int main(int argc, char* argv[])
                results.funcid, results.correct, results.misses);
         printf("\nTEST_TRANS_RESULTS=%d:%d\n", results.correct, results.misses);
     }
+
+    if (mismatches > 0) {
+        printf("\nError: In-process and valgrind counts differ for %d functions\n", mismatches);
+        return 1;
+    }
     return 0;
 }
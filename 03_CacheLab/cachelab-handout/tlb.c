@@ -0,0 +1,139 @@
+/*
+ * tlb.c - Two-level TLB and page walk model
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include "tlb.h"
+
+enum { DTLB, STLB };
+
+void tlb_init(Tlb *t) {
+    memset(t, 0, sizeof(*t));
+    t->levels[DTLB].entries = TLB_DTLB_ENTRIES;
+    t->levels[DTLB].ways = TLB_DTLB_WAYS;
+    t->levels[STLB].entries = TLB_STLB_ENTRIES;
+    t->levels[STLB].ways = TLB_STLB_WAYS;
+    t->page_bits = TLB_PAGE_BITS;
+    t->walk_latency = TLB_WALK_LATENCY;
+}
+
+const char *tlb_set(Tlb *t, const char *spec) {
+    char name[8];
+    char unit[4];
+    int a, c;
+    int n = sscanf(spec, "%7[^:]:%d:%d", name, &a, &c);
+
+    if (n >= 1 && strcmp(name, "page") == 0) {
+        if (sscanf(spec, "page:%3s", unit) != 1) {
+            return "pages take page:4k, page:2m or page:1g";
+        }
+        if (strcmp(unit, "4k") == 0) {
+            t->page_bits = 12;
+        }
+        else if (strcmp(unit, "2m") == 0) {
+            t->page_bits = 21;
+        }
+        else if (strcmp(unit, "1g") == 0) {
+            t->page_bits = 30;
+        }
+        else {
+            return "pages take page:4k, page:2m or page:1g";
+        }
+        return NULL;
+    }
+    if (n >= 1 && strcmp(name, "walk") == 0) {
+        if (n != 2 || a < 0) {
+            return "the walk takes walk:cycles";
+        }
+        t->walk_latency = a;
+        return NULL;
+    }
+
+    int level;
+    if (n >= 1 && strcmp(name, "dtlb") == 0) {
+        level = DTLB;
+    }
+    else if (n >= 1 && strcmp(name, "stlb") == 0) {
+        level = STLB;
+    }
+    else {
+        return "specs are dtlb:entries:ways, stlb:entries:ways, page:size or walk:cycles";
+    }
+    if (level == STLB && n == 2 && a == 0) {
+        t->levels[STLB].entries = 0;
+        return NULL;
+    }
+    if (n != 3 || a < 1 || c < 1 || a % c != 0) {
+        return "levels take name:entries:ways, entries a multiple of ways";
+    }
+    int sets = a / c;
+    if ((sets & (sets - 1)) != 0) {
+        return "entries/ways must be a power of two";
+    }
+    t->levels[level].entries = a;
+    t->levels[level].ways = c;
+    return NULL;
+}
+
+/* Cache of a TLB level, pages as blocks */
+static int init_level(Cache *cache, const TlbLevel *lv, int page_bits) {
+    int s = 0;
+    while ((1 << s) < lv->entries / lv->ways) {
+        s++;
+    }
+    if (s + page_bits >= 64) {
+        return -1;
+    }
+    return init_cache(cache, s, lv->ways, page_bits, find_policy("lru"));
+}
+
+const char *tlb_finish(Tlb *t) {
+    if (init_level(&t->dtlb, &t->levels[DTLB], t->page_bits) != 0) {
+        return "could not allocate the dtlb";
+    }
+    if (t->levels[STLB].entries > 0 &&
+        init_level(&t->stlb, &t->levels[STLB], t->page_bits) != 0) {
+        free_cache(&t->dtlb);
+        return "could not allocate the stlb";
+    }
+    return NULL;
+}
+
+/* Look up one page, walking the table if both levels miss */
+static void translate(Tlb *t, uint64_t addr) {
+    Evicted ev;
+    t->translations++;
+    if (access_block(&t->dtlb, addr, 0, &ev) == CACHE_HIT) {
+        return;
+    }
+    if (t->levels[STLB].entries > 0 &&
+        access_block(&t->stlb, addr, 0, &ev) == CACHE_HIT) {
+        return;
+    }
+    t->walks++;
+}
+
+void tlb_access(Tlb *t, uint64_t addr, int size) {
+    uint64_t page = addr >> t->page_bits;
+    uint64_t last = size > 0 ? (addr + size - 1) >> t->page_bits : page;
+    for (; page <= last; page++) {
+        translate(t, page << t->page_bits);
+    }
+}
+
+void tlb_print(const Tlb *t) {
+    //x86-64 four-level tables, huge pages end the walk early
+    int table_levels = 4 - (t->page_bits - 12) / 9;
+    uint64_t cycles = (uint64_t)t->walks * table_levels * t->walk_latency;
+    printf("dtlb-hits:%ld dtlb-misses:%ld stlb-hits:%ld stlb-misses:%ld page-walks:%ld walk-cycles:%lu\n",
+           t->dtlb.hits, t->dtlb.misses, t->stlb.hits, t->stlb.misses,
+           t->walks, cycles);
+}
+
+void tlb_free(Tlb *t) {
+    free_cache(&t->dtlb);
+    if (t->levels[STLB].entries > 0) {
+        free_cache(&t->stlb);
+    }
+}
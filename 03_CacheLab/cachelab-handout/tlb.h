@@ -0,0 +1,59 @@
+/*
+ * tlb.h - Two-level TLB and page walk model driven by the data trace
+ *
+ * An L1 DTLB sits in front of a second-level STLB. Each is a simulated
+ * cache whose blocks are pages: entries/ways sets of E=ways, with the
+ * page size as the block size. A translation that misses both levels
+ * walks the page table, one memory reference per table level (four for
+ * 4KB pages, three for 2MB and two for 1GB), and fills both levels.
+ */
+#ifndef CSIM_TLB_H
+#define CSIM_TLB_H
+
+#include "cache.h"
+
+/* Defaults, roughly a recent x86 core with 4KB pages */
+#define TLB_DTLB_ENTRIES 64
+#define TLB_DTLB_WAYS 4
+#define TLB_STLB_ENTRIES 1536
+#define TLB_STLB_WAYS 12
+#define TLB_PAGE_BITS 12
+#define TLB_WALK_LATENCY 20   /* cycles per page table reference */
+
+typedef struct {
+    int entries;
+    int ways;
+} TlbLevel;
+
+typedef struct {
+    TlbLevel levels[2];     /* dtlb, stlb (0 entries for none) */
+    int page_bits;
+    int walk_latency;
+    Cache dtlb;
+    Cache stlb;
+    long translations;      /* pages looked up, one or two per access */
+    long walks;
+} Tlb;
+
+/* Start from the defaults */
+void tlb_init(Tlb *t);
+
+/*
+ * Apply a spec "dtlb:entries:ways", "stlb:entries:ways" (stlb:0 for
+ * none), "page:4k", "page:2m", "page:1g" or "walk:cycles". Returns NULL
+ * on success, otherwise an error message.
+ */
+const char *tlb_set(Tlb *t, const char *spec);
+
+/* Allocate the levels once all specs are in. Returns NULL or an error message */
+const char *tlb_finish(Tlb *t);
+
+/* Translate every page size bytes at addr touch */
+void tlb_access(Tlb *t, uint64_t addr, int size);
+
+/* One summary line of TLB hits, misses and page walk cost */
+void tlb_print(const Tlb *t);
+
+void tlb_free(Tlb *t);
+
+#endif /* CSIM_TLB_H */
@@ -0,0 +1,575 @@
+/*
+ * trace.c - Memory trace readers used by the cache simulator
+ *
+ * Traces are in the Valgrind lackey format, one access per line:
+ *     I 0400d7d4,8
+ *      M 0421c7f0,4
+ *      L 04f6b868,8
+ *      S 7ff0005c8,8
+ * The file is mapped into memory and parsed in place with hand-rolled
+ * hex/decimal scanners instead of fscanf. The same reader also accepts
+ * the packed binary format described in trace.h, which costs only a
+ * sequential walk over a few bytes per access.
+ *
+ * Pipes are parsed the same way, one window of the stream at a time:
+ * the parsers stop at trace->end, and refill() slides whatever they
+ * left unparsed to the front of the window before reading more.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+/* Recognize a binary header at the start of the data */
+static int check_header(Trace *trace)
+{
+    if ((size_t)(trace->end - trace->cur) >= sizeof(TraceHeader) &&
+        memcmp(trace->cur, TRACE_MAGIC, 4) == 0) {
+        memcpy(&trace->header, trace->cur, sizeof(TraceHeader));
+        if (trace->header.version != TRACE_VERSION) {
+            return -1;
+        }
+        trace->binary = 1;
+        trace->cur += sizeof(TraceHeader);
+    }
+    return 0;
+}
+
+/*
+ * refill - Move the unparsed tail of the stream window to its front
+ *     and read more after it. Text windows end after their last newline
+ *     until the stream ends. Returns 1 if there is something to parse.
+ */
+static int refill(Trace *trace)
+{
+    if (!trace->stream || trace->eof) {
+        return 0;
+    }
+
+    size_t keep = trace->limit - trace->cur;
+    trace->base += trace->cur - trace->buf;
+    memmove(trace->buf, trace->cur, keep);
+    size_t have = keep;
+    int got_line = 0;
+
+    while (have < TRACE_STREAM_BUF && !got_line) {
+        ssize_t n = read(trace->fd, trace->buf + have, TRACE_STREAM_BUF - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            trace->eof = 1;
+            break;
+        }
+        have += n;
+        //A binary record may be cut anywhere, any new bytes will do
+        //(once the header is in)
+        got_line = have >= sizeof(TraceHeader) &&
+                   (trace->binary || memchr(trace->buf + keep, '\n', have - keep) != NULL);
+    }
+
+    trace->data = trace->cur = trace->buf;
+    trace->limit = trace->end = trace->buf + have;
+    if (!trace->binary && !trace->eof) {
+        //Leave a partial last line for next time
+        const char *p = trace->limit;
+        while (p > trace->buf && p[-1] != '\n') {
+            p--;
+        }
+        //Unless a single line fills the window
+        if (p > trace->buf) {
+            trace->end = p;
+        }
+    }
+    return trace->cur < trace->end;
+}
+
+int trace_open(Trace *trace, const char *path)
+{
+    memset(trace, 0, sizeof(*trace));
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        //Pipes and terminals are read through the window
+        trace->buf = malloc(TRACE_STREAM_BUF);
+        if (trace->buf == NULL) {
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            return -1;
+        }
+        trace->stream = 1;
+        trace->fd = fd;
+        trace->cur = trace->limit = trace->buf;
+        refill(trace);
+        if (check_header(trace) != 0) {
+            trace_close(trace);
+            return -1;
+        }
+        return 0;
+    }
+
+    trace->length = st.st_size;
+    trace->data = NULL;
+    if (trace->length > 0) {
+        void *map = mmap(NULL, trace->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        //We only ever walk forward through the file
+        posix_madvise(map, trace->length, POSIX_MADV_SEQUENTIAL);
+        trace->data = map;
+    }
+    //The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    trace->cur = trace->data;
+    trace->end = trace->limit = trace->data + trace->length;
+    if (check_header(trace) != 0) {
+        trace_close(trace);
+        return -1;
+    }
+    return 0;
+}
+
+void trace_tell(const Trace *trace, TracePos *pos)
+{
+    memset(pos, 0, sizeof(*pos));
+    pos->offset = trace->base + (trace->cur - trace->data);
+    pos->prev_addr = trace->prev_addr;
+    pos->records = trace->records;
+    if (trace->filter != NULL) {
+        pos->open = trace->filter->open;
+        pos->closed = trace->filter->closed;
+        pos->done = trace->filter->done;
+    }
+}
+
+int trace_seek(Trace *trace, const TracePos *pos)
+{
+    if (trace->stream) {
+        //Read up to pos, dropping everything before it
+        while (trace->base + (trace->end - trace->buf) < pos->offset) {
+            if (trace->eof) {
+                return -1;
+            }
+            trace->cur = trace->end;
+            refill(trace);
+        }
+        if (pos->offset < trace->base) {
+            return -1;
+        }
+        trace->cur = trace->buf + (pos->offset - trace->base);
+    }
+    else {
+        if (pos->offset > trace->length) {
+            return -1;
+        }
+        trace->cur = trace->data + pos->offset;
+    }
+    trace->prev_addr = pos->prev_addr;
+    trace->records = pos->records;
+    if (trace->filter != NULL) {
+        trace->filter->open = pos->open;
+        trace->filter->closed = pos->closed;
+        trace->filter->done = pos->done;
+    }
+    return 0;
+}
+
+void trace_close(Trace *trace)
+{
+    if (trace->stream) {
+        //Let the producer finish rather than die of a broken pipe
+        while (!trace->eof) {
+            trace->cur = trace->limit;
+            refill(trace);
+        }
+        if (trace->fd != STDIN_FILENO) {
+            close(trace->fd);
+        }
+        free(trace->buf);
+        trace->buf = NULL;
+        trace->stream = 0;
+    }
+    else if (trace->data != NULL) {
+        munmap((void *)trace->data, trace->length);
+    }
+    trace->data = trace->cur = trace->end = trace->limit = NULL;
+    trace->length = 0;
+}
+
+/* Value of a hex digit, or -1 if c is not one */
+static inline int hex_value(char c)
+{
+    unsigned d = (unsigned)(c - '0');
+    if (d < 10) {
+        return d;
+    }
+    d = (unsigned)((c | 0x20) - 'a');
+    if (d < 6) {
+        return d + 10;
+    }
+    return -1;
+}
+
+/* Move p past the end of the current line */
+static inline const char *skip_line(const char *p, const char *end)
+{
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+/* Decode an unsigned LEB128 varint, returns NULL if it is truncated */
+static inline const char *read_varint(const char *p, const char *end,
+                                      uint64_t *value)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        unsigned char byte = *p++;
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = v;
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+static const char op_chars[4] = {'L', 'S', 'M', 'I'};
+
+static int next_binary(Trace *trace, TraceRecord *rec)
+{
+    const char *p = trace->cur;
+    const char *end = trace->end;
+
+    while (p < end) {
+        const char *start = p;
+        unsigned char head = *p++;
+        uint64_t zz, size = head >> 2;
+
+        if ((p = read_varint(p, end, &zz)) == NULL ||
+            (size == TRACE_SIZE_ESCAPE && (p = read_varint(p, end, &size)) == NULL)) {
+            //Cut short, a stream may still hold the rest
+            trace->cur = start;
+            return 0;
+        }
+
+        //Undo the zigzag so small negative deltas stay small
+        trace->prev_addr += (zz >> 1) ^ -(zz & 1);
+
+        if ((head & 3) == TRACE_OP_I && !trace->ifetch) {
+            continue;
+        }
+        rec->op = op_chars[head & 3];
+        rec->addr = trace->prev_addr;
+        rec->size = (int)size;
+        trace->cur = p;
+        return 1;
+    }
+
+    trace->cur = end;
+    return 0;
+}
+
+static int next_text(Trace *trace, TraceRecord *rec)
+{
+    const char *p = trace->cur;
+    const char *end = trace->end;
+
+    while (p < end) {
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+
+        char op = *p;
+        if (op != 'L' && op != 'S' && op != 'M' &&
+            (op != 'I' || !trace->ifetch)) {
+            //Instruction fetches, blank and junk lines
+            p = skip_line(p, end);
+            continue;
+        }
+        p++;
+        while (p < end && *p == ' ') {
+            p++;
+        }
+
+        //Address in hex
+        uint64_t addr = 0;
+        const char *digits = p;
+        int v;
+        while (p < end && (v = hex_value(*p)) >= 0) {
+            addr = (addr << 4) | v;
+            p++;
+        }
+        if (p == digits || p == end || *p != ',') {
+            p = skip_line(p, end);
+            continue;
+        }
+        p++;
+
+        //Size in decimal
+        int size = 0;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            size = size * 10 + (*p - '0');
+            p++;
+        }
+
+        if (p < end && *p == '\n') {
+            p++;
+        }
+        else {
+            p = skip_line(p, end);
+        }
+
+        rec->op = op;
+        rec->addr = addr;
+        rec->size = size;
+        trace->cur = p;
+        return 1;
+    }
+
+    trace->cur = end;
+    return 0;
+}
+
+int trace_next(Trace *trace, TraceRecord *rec)
+{
+    TraceFilter *f = trace->filter;
+
+    while (f == NULL || !f->done) {
+        int got = trace->binary ? next_binary(trace, rec) : next_text(trace, rec);
+        if (!got) {
+            if (refill(trace)) {
+                continue;
+            }
+            return 0;
+        }
+        if (f == NULL) {
+            rec->regions = 1;
+            trace->records++;
+            return 1;
+        }
+        if (trace_filter_keep(f, rec)) {
+            trace->records++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void trace_filter_init(TraceFilter *f)
+{
+    memset(f, 0, sizeof(*f));
+    //Without markers the whole trace is region 0
+    f->open = 1;
+}
+
+int trace_filter_markers(TraceFilter *f, const char *arg)
+{
+    unsigned long long start, end;
+    int r = f->nmarkers;
+
+    if (r == MAX_REGIONS) {
+        return -1;
+    }
+    if (arg[0] == '@') {
+        if (arg[1] == '\0' || f->marker_file != NULL) {
+            return -1;
+        }
+        f->marker_file = arg + 1;
+        f->file_region = r;
+    }
+    else if (sscanf(arg, "%llx,%llx", &start, &end) == 2) {
+        f->marker_start[r] = start;
+        f->marker_end[r] = end;
+    }
+    else {
+        return -1;
+    }
+    f->nmarkers++;
+    f->open = 0;
+    return 0;
+}
+
+int trace_filter_range(TraceFilter *f, const char *arg, int exclude)
+{
+    unsigned long long lo, hi;
+    AddrRange *ranges = exclude ? f->exclude : f->include;
+    int *n = exclude ? &f->nexclude : &f->ninclude;
+
+    if (*n == MAX_RANGES || sscanf(arg, "%llx-%llx", &lo, &hi) != 2 || lo >= hi) {
+        return -1;
+    }
+    ranges[*n].lo = lo;
+    ranges[*n].hi = hi;
+    (*n)++;
+    return 0;
+}
+
+int trace_filter_regions(const TraceFilter *f)
+{
+    return f->nmarkers > 0 ? f->nmarkers : 1;
+}
+
+/*
+ * load_markers - Try to read the marker file. tracegen writes it before
+ *     touching either marker, so it is complete by the time the start
+ *     marker shows up in the trace. Its markers are volatile chars, so
+ *     only a byte store can be the start marker and only those records
+ *     are worth opening the file for.
+ */
+static int load_markers(TraceFilter *f)
+{
+    FILE *fp = fopen(f->marker_file, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    unsigned long long start, end;
+    int ok = fscanf(fp, "%llx %llx", &start, &end) == 2;
+    fclose(fp);
+    if (ok) {
+        f->marker_start[f->file_region] = start;
+        f->marker_end[f->file_region] = end;
+        f->marker_file = NULL;
+    }
+    return ok;
+}
+
+static int in_ranges(const AddrRange *ranges, int n, uint64_t addr)
+{
+    for (int i = 0; i < n; i++) {
+        if (addr >= ranges[i].lo && addr < ranges[i].hi) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int trace_filter_keep(TraceFilter *f, TraceRecord *rec)
+{
+    uint16_t ending = 0;
+
+    if (f->nmarkers > 0 && rec->op != 'I') {
+        //Regions cannot start before their markers are known
+        int pending = -1;
+        if (f->marker_file != NULL &&
+            !(rec->op == 'S' && rec->size == 1 && load_markers(f))) {
+            pending = f->file_region;
+        }
+        for (int r = 0; r < f->nmarkers; r++) {
+            uint16_t bit = 1 << r;
+            if (r == pending || (f->closed & bit)) {
+                continue;
+            }
+            if (rec->addr == f->marker_start[r]) {
+                f->open |= bit;
+            }
+            if (rec->addr == f->marker_end[r]) {
+                ending |= bit;
+            }
+        }
+    }
+
+    uint16_t regions = f->open;
+    if (ending) {
+        //The end marker itself is still in its region
+        f->open &= ~ending;
+        f->closed |= ending;
+        f->done = f->closed == (uint16_t)((1u << f->nmarkers) - 1);
+    }
+
+    if ((f->low_only && rec->addr >= 0xffffffff) ||
+        (f->ninclude > 0 && !in_ranges(f->include, f->ninclude, rec->addr)) ||
+        in_ranges(f->exclude, f->nexclude, rec->addr)) {
+        regions = 0;
+    }
+    rec->regions = regions;
+    return regions;
+}
+
+static void write_varint(FILE *fp, uint64_t v)
+{
+    while (v >= 0x80) {
+        putc((int)(v & 0x7f) | 0x80, fp);
+        v >>= 7;
+    }
+    putc((int)v, fp);
+}
+
+int trace_writer_open(TraceWriter *w, const char *path)
+{
+    w->fp = fopen(path, "wb");
+    if (w->fp == NULL) {
+        return -1;
+    }
+    w->prev_addr = 0;
+    memset(&w->header, 0, sizeof(w->header));
+    memcpy(w->header.magic, TRACE_MAGIC, 4);
+    w->header.version = TRACE_VERSION;
+
+    //Counts are unknown until close, write a placeholder for now
+    fwrite(&w->header, sizeof(w->header), 1, w->fp);
+    return 0;
+}
+
+void trace_write(TraceWriter *w, const TraceRecord *rec)
+{
+    int op;
+    switch (rec->op) {
+        case 'S': op = TRACE_OP_S; break;
+        case 'M': op = TRACE_OP_M; break;
+        case 'I': op = TRACE_OP_I; break;
+        default:  op = TRACE_OP_L; break;
+    }
+    unsigned size = rec->size < 0 ? 0 : (unsigned)rec->size;
+    int escape = size >= TRACE_SIZE_ESCAPE;
+
+    putc(op | ((escape ? TRACE_SIZE_ESCAPE : size) << 2), w->fp);
+
+    uint64_t delta = rec->addr - w->prev_addr;
+    write_varint(w->fp, (delta << 1) ^ (uint64_t)((int64_t)delta >> 63));
+    if (escape) {
+        write_varint(w->fp, size);
+    }
+    w->prev_addr = rec->addr;
+
+    w->header.records++;
+    if (op == TRACE_OP_I) {
+        w->header.instructions++;
+    }
+}
+
+int trace_writer_close(TraceWriter *w)
+{
+    int ok = fseek(w->fp, 0, SEEK_SET) == 0 &&
+             fwrite(&w->header, sizeof(w->header), 1, w->fp) == 1;
+    if (fclose(w->fp) != 0) {
+        ok = 0;
+    }
+    w->fp = NULL;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,189 @@
+/*
+ * trace.h - Memory trace readers used by the cache simulator
+ */
+#ifndef CSIM_TRACE_H
+#define CSIM_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* One memory access from a trace */
+typedef struct {
+    char op;        /* 'L', 'S', 'M' or 'I' */
+    uint16_t regions; /* bit r set if in marker region r (see TraceFilter) */
+    int size;       /* number of bytes accessed */
+    uint64_t addr;  /* address of the first byte */
+} TraceRecord;
+
+/*
+ * Binary trace format
+ *
+ * A TraceHeader followed by one variable length record per access:
+ *   byte 0     op in bits 0-1 (TRACE_OP_*), size in bits 2-7. A size
+ *              of TRACE_SIZE_ESCAPE means the real size follows the
+ *              address as an unsigned LEB128 varint.
+ *   varint     address minus the previous record's address, zigzag
+ *              encoded as an unsigned LEB128 varint
+ * Most records in a lackey trace are 2-3 bytes.
+ */
+#define TRACE_MAGIC "CSBT"
+#define TRACE_VERSION 2
+#define TRACE_SIZE_ESCAPE 63
+
+enum { TRACE_OP_L, TRACE_OP_S, TRACE_OP_M, TRACE_OP_I };
+
+typedef struct {
+    char magic[4];          /* TRACE_MAGIC */
+    uint32_t version;       /* TRACE_VERSION */
+    uint64_t records;       /* total records, including instructions */
+    uint64_t instructions;  /* I records */
+} TraceHeader;
+
+/*
+ * TraceFilter - Regions of interest of a lackey trace. Marker region r
+ * runs from the first data access to marker_start[r] to the next one to
+ * marker_end[r] (both kept); regions may overlap and every record is
+ * tagged with the regions it falls in. Without markers there is a
+ * single region 0 spanning the whole trace.
+ *
+ * Addresses must also fall in one of the include ranges, if any, and
+ * in none of the exclude ranges. low_only keeps just the low 32-bit
+ * address space, which drops Valgrind's own stack traffic.
+ */
+#define MAX_REGIONS 16
+#define MAX_RANGES 16
+
+typedef struct {
+    uint64_t lo;        /* first address */
+    uint64_t hi;        /* one past the last */
+} AddrRange;
+
+typedef struct {
+    int nmarkers;       /* marker regions, 0 for the whole trace */
+    uint64_t marker_start[MAX_REGIONS];
+    uint64_t marker_end[MAX_REGIONS];
+    const char *marker_file; /* markers still to be read from this file */
+    int file_region;    /* the region they are for */
+    AddrRange include[MAX_RANGES];
+    int ninclude;
+    AddrRange exclude[MAX_RANGES];
+    int nexclude;
+    int low_only;
+    uint16_t open;      /* regions between their markers */
+    uint16_t closed;    /* regions past their end marker */
+    int done;           /* every region is closed */
+} TraceFilter;
+
+/*
+ * Trace - A trace file mapped read-only into memory. The parser walks
+ * the mapped bytes directly, so no data is copied through stdio.
+ * Text and binary traces are told apart by the header magic.
+ *
+ * Pipes and stdin ("-") cannot be mapped and are streamed instead
+ * through a fixed TRACE_STREAM_BUF byte window, so memory stays bounded
+ * however long the trace is. The window only ever ends on a whole text
+ * line; a binary record cut at its end is parsed after the next read.
+ */
+#define TRACE_STREAM_BUF (1 << 20)
+
+typedef struct {
+    const char *data;   /* start of the mapping or stream window */
+    const char *cur;    /* next byte to parse */
+    const char *end;    /* one past the last byte to parse */
+    size_t length;
+    int binary;         /* set for the binary format */
+    int ifetch;         /* set to also return I records */
+    uint64_t prev_addr; /* delta base for binary records */
+    TraceHeader header; /* only valid for binary traces */
+    int stream;         /* set when reading through the window */
+    int fd;             /* streamed descriptor */
+    int eof;            /* nothing more to read from fd */
+    char *buf;          /* the stream window */
+    const char *limit;  /* one past the last byte read into it */
+    uint64_t base;      /* offset in the trace of data[0] */
+    uint64_t records;   /* returned by trace_next() so far */
+    TraceFilter *filter;/* NULL, or records to keep */
+} Trace;
+
+/* Where a trace is up to, enough to pick it up again (see trace_seek()) */
+typedef struct {
+    uint64_t offset;    /* of the next byte to parse */
+    uint64_t prev_addr; /* binary delta base */
+    uint64_t records;   /* returned before it */
+    uint16_t open;      /* the filter's open and closed regions */
+    uint16_t closed;
+    int32_t done;
+} TracePos;
+
+/*
+ * Map the trace at path, or stream it if path is "-" (stdin) or not a
+ * regular file. Returns 0 on success, -1 on error
+ */
+int trace_open(Trace *trace, const char *path);
+
+/*
+ * Parse the next data access into rec. Instruction fetches (I lines)
+ * are skipped unless trace->ifetch is set, malformed lines always are,
+ * and so are records trace->filter drops.
+ * Returns 1 if rec was filled, 0 at end of trace (or of the region).
+ */
+int trace_next(Trace *trace, TraceRecord *rec);
+
+/* The position after the last record returned */
+void trace_tell(const Trace *trace, TracePos *pos);
+
+/*
+ * Continue from pos, which must come from trace_tell() on the same
+ * trace and filter. A stream can only move forward and skips the bytes
+ * up to pos by reading them. Returns 0 on success, -1 if pos is past
+ * the end.
+ */
+int trace_seek(Trace *trace, const TracePos *pos);
+
+/* Unmap the trace, or drain and close the stream */
+void trace_close(Trace *trace);
+
+/* A filter that keeps everything */
+void trace_filter_init(TraceFilter *f);
+
+/*
+ * Add a marker region from "start,end" in hex, or "@file" to read them
+ * from a file in that format (tracegen's .marker) once it has been
+ * written. Returns 0 on success, -1 if malformed or too many.
+ */
+int trace_filter_markers(TraceFilter *f, const char *arg);
+
+/*
+ * Add an include (exclude set) or exclude address range "lo-hi" in
+ * hex, hi being one past the last address. Returns 0 on success, -1 if
+ * malformed or too many.
+ */
+int trace_filter_range(TraceFilter *f, const char *arg, int exclude);
+
+/* Number of regions records are tagged with */
+int trace_filter_regions(const TraceFilter *f);
+
+/*
+ * Tag rec with the regions it is in and return them, 0 if it is to be
+ * dropped. Sets f->done once the last region ends.
+ */
+int trace_filter_keep(TraceFilter *f, TraceRecord *rec);
+
+/* TraceWriter - Sequential writer for the binary format */
+typedef struct {
+    FILE *fp;
+    uint64_t prev_addr;
+    TraceHeader header;
+} TraceWriter;
+
+/* Create a binary trace at path. Returns 0 on success, -1 on error */
+int trace_writer_open(TraceWriter *w, const char *path);
+
+/* Append one record */
+void trace_write(TraceWriter *w, const TraceRecord *rec);
+
+/* Fill in the header counts and close. Returns 0 on success */
+int trace_writer_close(TraceWriter *w);
+
+#endif /* CSIM_TRACE_H */
@@ -0,0 +1,105 @@
+/*
+ * trace2bin.c - Converts a Valgrind lackey text trace into the packed
+ *     binary format read natively by csim (see trace.h).
+ *
+ * Optionally cuts the trace down to the region between two marker
+ * addresses and drops high (stack) addresses, the same filtering
+ * test-trans applies before handing a trace to the simulator. The cut
+ * trace is the region, so csim needs no -m for it; the marker accesses
+ * are kept, so -m can still pick out regions of a union of several.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace.h"
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hl] [-m <start>,<end>] -i <text trace> -o <binary trace>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h                Print this help message.\n");
+    printf("  -i <file>         Text trace to convert, - for stdin.\n");
+    printf("  -o <file>         Binary trace to write.\n");
+    printf("  -m <start>,<end>  Keep only the region between these hex marker addresses\n");
+    printf("                    (or -m @file to read them from tracegen's .marker).\n");
+    printf("  -l                Keep only addresses in the low 32-bit address space.\n");
+    printf("Example: %s -m 6020c0,6020c1 -l -i trace.tmp -o trace.bin\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int c;
+    char *in_file = NULL;
+    char *out_file = NULL;
+    TraceFilter filter;
+
+    trace_filter_init(&filter);
+
+    while ((c = getopt(argc, argv, "hi:o:m:l")) != -1) {
+        switch (c) {
+        case 'i':
+            in_file = optarg;
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'm':
+            if (trace_filter_markers(&filter, optarg) != 0) {
+                printf("Error: Bad marker pair %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'l':
+            filter.low_only = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (in_file == NULL || out_file == NULL) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    Trace trace;
+    if (trace_open(&trace, in_file) != 0) {
+        fprintf(stderr, "Error: Could not open file %s\n", in_file);
+        exit(1);
+    }
+    //Keep instruction fetches, they are part of the trace
+    trace.ifetch = 1;
+    trace.filter = &filter;
+
+    TraceWriter writer;
+    if (trace_writer_open(&writer, out_file) != 0) {
+        fprintf(stderr, "Error: Could not create file %s\n", out_file);
+        exit(1);
+    }
+
+    /* Only the region of interest comes out of trace_next() */
+    TraceRecord rec;
+    while (trace_next(&trace, &rec)) {
+        trace_write(&writer, &rec);
+    }
+    trace_close(&trace);
+
+    if (trace_writer_close(&writer) != 0) {
+        fprintf(stderr, "Error: Could not write file %s\n", out_file);
+        exit(1);
+    }
+
+    printf("%llu records (%llu instructions) written to %s\n",
+           (unsigned long long)writer.header.records,
+           (unsigned long long)writer.header.instructions, out_file);
+    return 0;
+}
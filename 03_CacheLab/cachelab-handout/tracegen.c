@@ -3,8 +3,8 @@
  * a memory trace of all of the registered transpose functions. 
  * 
  * The beginning and end of each registered transpose function's trace
- * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * is indicated by writing to "marker" addresses (see region.c). These
+ * two marker addresses are recorded in file for later use.
  */
 
 #include <stdlib.h>
@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "region.h"
 #include <string.h>
 
 /* External variables declared in cachelab.c */
@@ -22,11 +23,6 @@ extern int func_counter;
 /* External function from trans.c */
 extern void registerFunctions();
 
-/* Markers used to bound trace regions of interest */
-volatile char MARKER_START, MARKER_END;
-
-static int A[256][256];
-static int B[256][256];
 static int M;
 static int N;
 
@@ -74,30 +70,26 @@ int main(int argc, char* argv[]){
     registerFunctions();
 
     /* Fill A with data */
-    initMatrix(M,N, A, B); 
+    initMatrix(M,N, region.A, region.B); 
 
     /* Record marker addresses */
     FILE* marker_fp = fopen(".marker","w");
     assert(marker_fp);
     fprintf(marker_fp, "%llx %llx", 
-            (unsigned long long int) &MARKER_START,
-            (unsigned long long int) &MARKER_END );
+            (unsigned long long int) &region.marker_start,
+            (unsigned long long int) &region.marker_end );
     fclose(marker_fp);
 
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            run_region(func_list[i].func_ptr, M, N);
+            if (!validate(i,M,N,region.A,region.B))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        run_region(func_list[selectedFunc].func_ptr, M, N);
+        if (!validate(selectedFunc,M,N,region.A,region.B))
             return selectedFunc+1;
 
     }
@@ -0,0 +1,43 @@
+/*
+ * tracer.c - Access hooks for the in-process memory tracer
+ *
+ * Each hook mirrors what lackey would log for the access: a load or a
+ * store of size bytes at addr. Accesses outside the traced range are
+ * dropped, the way csim -l drops the stack in the valgrind trace.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "tracer.h"
+
+static CSim *traced;
+static uintptr_t trace_lo, trace_hi;
+
+void tracer_start(CSim *sim, const void *lo, const void *hi) {
+    trace_lo = (uintptr_t)lo;
+    trace_hi = (uintptr_t)hi;
+    traced = sim;
+}
+
+void tracer_stop(void) {
+    traced = NULL;
+}
+
+static inline void record(char op, const volatile void *addr, int size) {
+    uintptr_t a = (uintptr_t)addr;
+    if (traced != NULL && a >= trace_lo && a < trace_hi) {
+        csim_access(traced, op, a, size);
+    }
+}
+
+/* Called by LOAD() and STORE() in a TRACE_TRANS build, see cachelab.h */
+void tracer_load(const volatile void *addr, int size);
+long tracer_store(const volatile void *addr, int size, long v);
+
+void tracer_load(const volatile void *addr, int size) {
+    record('L', addr, size);
+}
+
+long tracer_store(const volatile void *addr, int size, long v) {
+    record('S', addr, size);
+    return v;
+}
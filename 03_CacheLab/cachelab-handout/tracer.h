@@ -0,0 +1,20 @@
+/*
+ * tracer.h - In-process memory tracer for the transpose functions
+ *
+ * trans.c and region.c are compiled a second time with TRACE_TRANS,
+ * which turns their LOAD() and STORE() accesses (see cachelab.h) into
+ * calls to tracer_load() and tracer_store() here. Those in the traced
+ * address range go straight into a simulated cache, so no valgrind,
+ * trace file or separate simulator is needed.
+ */
+#ifndef CSIM_TRACER_H
+#define CSIM_TRACER_H
+
+#include "libcsim.h"
+
+/* Simulate every access to [lo, hi) on sim until tracer_stop() */
+void tracer_start(CSim *sim, const void *lo, const void *hi);
+
+void tracer_stop(void);
+
+#endif /* CSIM_TRACER_H */
@@ -3,6 +3,8 @@
  *
  * Each transpose function must have a prototype of the form:
  * void trans(int M, int N, int A[N][M], int B[M][N]);
+ * and read A and B through LOAD() and write them through STORE() (see
+ * cachelab.h), which is how test-trans sees its accesses.
  *
  * A transpose function is evaluated by counting the number of misses
  * on a 1KB direct mapped cache with a block size of 32 bytes.
@@ -39,31 +41,31 @@ void transpose_simple_buffer(int M, int N, int A[N][M], int B[M][N])
 
             if (((N-i) >= 8) && ((M-j) >= 8)) {
                 for (ii = 0; ii < 8; ii++) {
-                    v0 = A[i + ii][j + 0];
-                    v1 = A[i + ii][j + 1];
-                    v2 = A[i + ii][j + 2];
-                    v3 = A[i + ii][j + 3];
-                    v4 = A[i + ii][j + 4];
-                    v5 = A[i + ii][j + 5];
-                    v6 = A[i + ii][j + 6];
-                    v7 = A[i + ii][j + 7];
-
-                    B[j + 0][i + ii] = v0;
-                    B[j + 1][i + ii] = v1;
-                    B[j + 2][i + ii] = v2;
-                    B[j + 3][i + ii] = v3;
-                    B[j + 4][i + ii] = v4;
-                    B[j + 5][i + ii] = v5;
-                    B[j + 6][i + ii] = v6;
-                    B[j + 7][i + ii] = v7;
+                    v0 = LOAD(A[i + ii][j + 0]);
+                    v1 = LOAD(A[i + ii][j + 1]);
+                    v2 = LOAD(A[i + ii][j + 2]);
+                    v3 = LOAD(A[i + ii][j + 3]);
+                    v4 = LOAD(A[i + ii][j + 4]);
+                    v5 = LOAD(A[i + ii][j + 5]);
+                    v6 = LOAD(A[i + ii][j + 6]);
+                    v7 = LOAD(A[i + ii][j + 7]);
+
+                    STORE(B[j + 0][i + ii], v0);
+                    STORE(B[j + 1][i + ii], v1);
+                    STORE(B[j + 2][i + ii], v2);
+                    STORE(B[j + 3][i + ii], v3);
+                    STORE(B[j + 4][i + ii], v4);
+                    STORE(B[j + 5][i + ii], v5);
+                    STORE(B[j + 6][i + ii], v6);
+                    STORE(B[j + 7][i + ii], v7);
                 }
             }
             else {
                 int tmp;
                 for (int ii=i; ii < min(N, i+8); ii++) {
                     for (int jj=j; jj < min(M, j+8); jj++) {
-                        tmp = A[ii][jj];
-                        B[jj][ii] = tmp;
+                        tmp = LOAD(A[ii][jj]);
+                        STORE(B[jj][ii], tmp);
                     }
                 }
             }
@@ -86,8 +88,8 @@ void transpose_unblocked(int M, int N, int A[N][M], int B[M][N])
             if (((N-i) >= 8) && ((M-j) >= 8)) {
                 for (ii = 0; ii < 8; ii++) {
                     for (jj = 0; jj < 8; jj++) {
-                        tmp = A[i + ii][j + jj];
-                        B[j + jj][i + ii] = tmp;
+                        tmp = LOAD(A[i + ii][j + jj]);
+                        STORE(B[j + jj][i + ii], tmp);
                     }
                 }
             }
@@ -95,8 +97,8 @@ void transpose_unblocked(int M, int N, int A[N][M], int B[M][N])
                 int tmp;
                 for (int ii=i; ii < min(N, i+8); ii++) {
                     for (int jj=j; jj < min(M, j+8); jj++) {
-                        tmp = A[ii][jj];
-                        B[jj][ii] = tmp;
+                        tmp = LOAD(A[ii][jj]);
+                        STORE(B[jj][ii], tmp);
                     }
                 }
             }
@@ -119,16 +121,16 @@ void transpose_unblocked_wa(int M, int N, int A[N][M], int B[M][N])
             if (((N-i) >= 4) && ((M-j) >= 4)) {
                 for (ii = 0; ii < 4; ii++) {
                     for (jj = 0; jj < 4; jj++) {
-                        tmp = A[i + ii][j + jj];
-                        B[j + jj][i + ii] = tmp;
+                        tmp = LOAD(A[i + ii][j + jj]);
+                        STORE(B[j + jj][i + ii], tmp);
                     }
                 }
             }
             else {
                 for (int ii=i; ii < min(N, i+4); ii++) {
                     for (int jj=j; jj < min(M, j+4); jj++) {
-                        tmp = A[ii][jj];
-                        B[jj][ii] = tmp;
+                        tmp = LOAD(A[ii][jj]);
+                        STORE(B[jj][ii], tmp);
                     }
                 }
             }
@@ -186,23 +188,23 @@ void edge_routine(int i, int j, int M, int N, int A[N][M] ,int B[M][N]) {
     for (int ii=i; ii < min(N, i+8); ii++) {
         int remaining_width = min(M, j+8) - j;
 
-        if (remaining_width >= 1) v0 = A[ii][j+0];
-        if (remaining_width >= 2) v1 = A[ii][j+1];
-        if (remaining_width >= 3) v2 = A[ii][j+2];
-        if (remaining_width >= 4) v3 = A[ii][j+3];
-        if (remaining_width >= 5) v4 = A[ii][j+4];
-        if (remaining_width >= 6) v5 = A[ii][j+5];
-        if (remaining_width >= 7) v6 = A[ii][j+6];
-        if (remaining_width >= 8) v7 = A[ii][j+7];
-
-        if (remaining_width >= 1) B[j + 0][ii] = v0;
-        if (remaining_width >= 2) B[j + 1][ii] = v1;
-        if (remaining_width >= 3) B[j + 2][ii] = v2;
-        if (remaining_width >= 4) B[j + 3][ii] = v3;
-        if (remaining_width >= 5) B[j + 4][ii] = v4;
-        if (remaining_width >= 6) B[j + 5][ii] = v5;
-        if (remaining_width >= 7) B[j + 6][ii] = v6;
-        if (remaining_width >= 8) B[j + 7][ii] = v7;
+        if (remaining_width >= 1) v0 = LOAD(A[ii][j+0]);
+        if (remaining_width >= 2) v1 = LOAD(A[ii][j+1]);
+        if (remaining_width >= 3) v2 = LOAD(A[ii][j+2]);
+        if (remaining_width >= 4) v3 = LOAD(A[ii][j+3]);
+        if (remaining_width >= 5) v4 = LOAD(A[ii][j+4]);
+        if (remaining_width >= 6) v5 = LOAD(A[ii][j+5]);
+        if (remaining_width >= 7) v6 = LOAD(A[ii][j+6]);
+        if (remaining_width >= 8) v7 = LOAD(A[ii][j+7]);
+
+        if (remaining_width >= 1) STORE(B[j + 0][ii], v0);
+        if (remaining_width >= 2) STORE(B[j + 1][ii], v1);
+        if (remaining_width >= 3) STORE(B[j + 2][ii], v2);
+        if (remaining_width >= 4) STORE(B[j + 3][ii], v3);
+        if (remaining_width >= 5) STORE(B[j + 4][ii], v4);
+        if (remaining_width >= 6) STORE(B[j + 5][ii], v5);
+        if (remaining_width >= 7) STORE(B[j + 6][ii], v6);
+        if (remaining_width >= 8) STORE(B[j + 7][ii], v7);
     }
 
 }
@@ -214,69 +216,69 @@ void subblock_routine(int i, int j, int M, int N, int A[N][M] ,int B[M][N]) {
 
     //Flip Q1 and store extra data in Q2 (as a buffer)
     for (k = 0; k < 4; k++ ){
-        v0 = A[i + k][j + 0];
-        v1 = A[i + k][j + 1];
-        v2 = A[i + k][j + 2];
-        v3 = A[i + k][j + 3];
-        v4 = A[i + k][j + 4];
-        v5 = A[i + k][j + 5];
-        v6 = A[i + k][j + 6];
-        v7 = A[i + k][j + 7];
+        v0 = LOAD(A[i + k][j + 0]);
+        v1 = LOAD(A[i + k][j + 1]);
+        v2 = LOAD(A[i + k][j + 2]);
+        v3 = LOAD(A[i + k][j + 3]);
+        v4 = LOAD(A[i + k][j + 4]);
+        v5 = LOAD(A[i + k][j + 5]);
+        v6 = LOAD(A[i + k][j + 6]);
+        v7 = LOAD(A[i + k][j + 7]);
 
         //Transpose top left
-        B[j + 0][i + k] = v0;
-        B[j + 1][i + k] = v1;
-        B[j + 2][i + k] = v2;
-        B[j + 3][i + k] = v3;
+        STORE(B[j + 0][i + k], v0);
+        STORE(B[j + 1][i + k], v1);
+        STORE(B[j + 2][i + k], v2);
+        STORE(B[j + 3][i + k], v3);
 
         //Store extra data
-        B[j + 0][i + k + 4] = v4;
-        B[j + 1][i + k + 4] = v5;
-        B[j + 2][i + k + 4] = v6;
-        B[j + 3][i + k + 4] = v7;
+        STORE(B[j + 0][i + k + 4], v4);
+        STORE(B[j + 1][i + k + 4], v5);
+        STORE(B[j + 2][i + k + 4], v6);
+        STORE(B[j + 3][i + k + 4], v7);
     }
 
     //Flip Q2 and Q3
     //Average of 2 misses per loop
     for (k = 0; k < 4; k++ ){
         //Load row0 of Q2 into registers (single set!)
-        v0 = B[j + k][i + 4];
-        v1 = B[j + k][i + 5];
-        v2 = B[j + k][i + 6];
-        v3 = B[j + k][i + 7];
+        v0 = LOAD(B[j + k][i + 4]);
+        v1 = LOAD(B[j + k][i + 5]);
+        v2 = LOAD(B[j + k][i + 6]);
+        v3 = LOAD(B[j + k][i + 7]);
 
         //Q3: Load the column of A (to replace data above in Q2)
         //4 sets
-        v4 = A[i + 4][j + k];
-        v5 = A[i + 5][j + k];
-        v6 = A[i + 6][j + k];
-        v7 = A[i + 7][j + k];
+        v4 = LOAD(A[i + 4][j + k]);
+        v5 = LOAD(A[i + 5][j + k]);
+        v6 = LOAD(A[i + 6][j + k]);
+        v7 = LOAD(A[i + 7][j + k]);
 
         //Write to Q2 (miss)
-        B[j + k][i + 4] = v4;
-        B[j + k][i + 5] = v5;
-        B[j + k][i + 6] = v6;
-        B[j + k][i + 7] = v7;
+        STORE(B[j + k][i + 4], v4);
+        STORE(B[j + k][i + 5], v5);
+        STORE(B[j + k][i + 6], v6);
+        STORE(B[j + k][i + 7], v7);
 
         //Write to Q3 (miss)
-        B[j + k + 4][i + 0] = v0;
-        B[j + k + 4][i + 1] = v1;
-        B[j + k + 4][i + 2] = v2;
-        B[j + k + 4][i + 3] = v3;
+        STORE(B[j + k + 4][i + 0], v0);
+        STORE(B[j + k + 4][i + 1], v1);
+        STORE(B[j + k + 4][i + 2], v2);
+        STORE(B[j + k + 4][i + 3], v3);
     }
 
     //Q4
     for (k = 4; k < 8; k++ ){
-        v4 = A[i + k][j + 4];
-        v5 = A[i + k][j + 5];
-        v6 = A[i + k][j + 6];
-        v7 = A[i + k][j + 7];
+        v4 = LOAD(A[i + k][j + 4]);
+        v5 = LOAD(A[i + k][j + 5]);
+        v6 = LOAD(A[i + k][j + 6]);
+        v7 = LOAD(A[i + k][j + 7]);
 
         //Transpose top left
-        B[j + 4][i + k] = v4;
-        B[j + 5][i + k] = v5;
-        B[j + 6][i + k] = v6;
-        B[j + 7][i + k] = v7;
+        STORE(B[j + 4][i + k], v4);
+        STORE(B[j + 5][i + k], v5);
+        STORE(B[j + 6][i + k], v6);
+        STORE(B[j + 7][i + k], v7);
     }
 
 
@@ -299,8 +301,8 @@ void trans(int M, int N, int A[N][M], int B[M][N])
         //Stride 1 on A
         //Stide N on B
         for (j = 0; j < M; j++) {
-            tmp = A[i][j];
-            B[j][i] = tmp;
+            tmp = LOAD(A[i][j]);
+            STORE(B[j][i], tmp);
         }
     }
 
@@ -339,7 +341,7 @@ int is_transpose(int M, int N, int A[N][M], int B[M][N])
 
     for (i = 0; i < N; i++) {
         for (j = 0; j < M; ++j) {
-            if (A[i][j] != B[j][i]) {
+            if (LOAD(A[i][j]) != LOAD(B[j][i])) {
                 return 0;
             }
         }